@@ -0,0 +1,205 @@
+#pragma once
+
+#include <stddef.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "mySimd.h"
+#include "myFFT.h"
+#include "myThreads.h"
+
+//convolution with a long impulse response, uniformly partitioned and overlap-save.
+//the response is cut into partitions of blockSize samples, each kept as the spectrum of an fft of
+//twice that length. every block of input is transformed once, and its spectrum kept in a delay line
+//of as many spectra as there are partitions. a block of output is then the sum over the partitions of
+//their spectrum times that of the input as many blocks ago, transformed back, keeping its second half.
+//a block costs two ffts and partitions*(blockSize+1) complex multiplications, against
+//blockSize*length for a direct fir, and the output lags the input by one block
+class PartitionedConvolver{
+private:
+    size_t block;
+    RealFFT fft;
+    size_t bins;
+    size_t partitions;
+    //spectra of the partitions, and of the inputs of the last partitions blocks, partition after partition
+    AlignedVector<float> filterRe, filterIm;
+    AlignedVector<float> delayRe, delayIm;
+    size_t newest = 0;
+    //the last two blocks of input, and the sum of the products
+    AlignedVector<float> input, result;
+    AlignedVector<float> sumRe, sumIm;
+
+public:
+    PartitionedConvolver(std::span<const float> response, size_t blockSize = 256)
+        :block(blockSize), fft(2*blockSize), bins(fft.bins()),
+        partitions(std::max(size_t(1), (response.size()+blockSize-1)/blockSize)),
+        filterRe(partitions*bins), filterIm(partitions*bins),
+        delayRe(partitions*bins, 0), delayIm(partitions*bins, 0),
+        input(2*blockSize, 0), result(2*blockSize), sumRe(bins), sumIm(bins)
+    {
+        AlignedVector<float> padded(2*block);
+        //the inverse fft scales by its length, which is folded into the partitions
+        float scale = 1.f/float(2*block);
+        for(size_t p = 0; p<partitions; ++p){
+            std::fill(padded.begin(), padded.end(), 0.f);
+            for(size_t i = 0; i<block && p*block+i < response.size(); ++i)
+                padded[i] = response[p*block+i]*scale;
+            fft.forward(padded.data(), filterRe.data()+p*bins, filterIm.data()+p*bins);
+        }
+    }
+
+    size_t blockSize() const {return block;}
+    size_t partitionCount() const {return partitions;}
+
+    //convolves blockSize samples in place
+    void process(float* samples){
+        memmove(input.data(), input.data()+block, block*sizeof(float));
+        memcpy(input.data()+block, samples, block*sizeof(float));
+        newest = newest ? newest-1 : partitions-1;
+        fft.forward(input.data(), delayRe.data()+newest*bins, delayIm.data()+newest*bins);
+
+        std::fill(sumRe.begin(), sumRe.end(), 0.f);
+        std::fill(sumIm.begin(), sumIm.end(), 0.f);
+        float* __restrict sr = sumRe.data();
+        float* __restrict si = sumIm.data();
+        for(size_t p = 0; p<partitions; ++p){
+            //the delay line runs backwards, so the input p blocks ago sits p slots after the newest
+            size_t slot = (newest+p)%partitions;
+            const float* __restrict xr = delayRe.data()+slot*bins;
+            const float* __restrict xi = delayIm.data()+slot*bins;
+            const float* __restrict hr = filterRe.data()+p*bins;
+            const float* __restrict hi = filterIm.data()+p*bins;
+            for(size_t k = 0; k<bins; ++k){
+                sr[k] += xr[k]*hr[k] - xi[k]*hi[k];
+                si[k] += xr[k]*hi[k] + xi[k]*hr[k];
+            }
+        }
+        fft.inverse(sumRe.data(), sumIm.data(), result.data());
+        memcpy(samples, result.data()+block, block*sizeof(float));
+    }
+};
+
+//a PartitionedConvolver running on its own thread, such as the body of an instrument behind its strings.
+//process() hands a block of samples to the worker through one SpscRing and takes the mix of the
+//dry and convolved samples back from another, so the caller never waits on the convolution.
+//the output ring starts with latency samples of silence, which is how far the output lags the input,
+//and how long the worker has to keep up. a call takes up to maxBlock samples, so the latency is at least
+//maxBlock plus one block of the convolver. the caller only sets an atomic flag and notifies the worker
+//waiting on it, there is no mutex to contend for. if the worker falls behind, the missing samples are zeros, and
+//the output it catches up with later is dropped so the lag returns to latency samples
+class BodyResonator{
+public:
+    std::atomic<float> dry{0.5f};
+    std::atomic<float> wet{0.5f};
+
+    BodyResonator(std::span<const float> response, size_t blockSize = 256, size_t maxBlock = 4096, size_t latency = 0)
+        :convolver(response, blockSize), delay(std::max(latency, maxBlock+blockSize)),
+        in(2*(delay+maxBlock)), out(2*(delay+maxBlock))
+    {
+        std::vector<float> silence(delay, 0.f);
+        out.push(silence);
+        worker = std::thread(&BodyResonator::workerLoop, this);
+    }
+    ~BodyResonator(){
+        quitting.store(true, std::memory_order_release);
+        pending.store(true, std::memory_order_release);
+        pending.notify_one();
+        worker.join();
+    }
+    BodyResonator(const BodyResonator&) = delete;
+    BodyResonator& operator=(const BodyResonator&) = delete;
+
+    size_t latency() const {return delay;}
+    //samples lost because the worker fell behind, input that did not fit and output replaced by zeros
+    size_t underruns() const {return missed.load(std::memory_order_relaxed);}
+
+    //replaces samples by the output latency samples ago
+    void process(std::span<float> samples){
+        size_t taken = in.push(samples);
+        pending.store(true, std::memory_order_release);
+        pending.notify_one();
+        size_t lost = samples.size()-taken;
+
+        size_t got = out.pop(samples);
+        if(got < samples.size()){
+            std::fill(samples.begin()+got, samples.end(), 0.f);
+            lost += samples.size()-got;
+        }
+        //after an underrun the worker delivers more than the lag allows, the oldest of it goes
+        size_t queued = out.size() + in.size();
+        if(queued > delay) out.drop(queued-delay);
+        if(lost) missed.fetch_add(lost, std::memory_order_relaxed);
+    }
+
+private:
+    PartitionedConvolver convolver;
+    size_t delay;
+    SpscRing<float> in, out;
+    std::thread worker;
+    std::atomic<size_t> missed{0};
+
+    //set by process() whenever it hands over input, and taken back by the worker before it drains in
+    std::atomic<bool> pending{false};
+    std::atomic<bool> quitting{false};
+
+    void workerLoop(){
+        size_t block = convolver.blockSize();
+        std::vector<float> source(block), samples(block);
+        while(true){
+            pending.wait(false, std::memory_order_acquire);
+            if(quitting.load(std::memory_order_acquire)) return;
+            //a flag set again while draining leaves the next wait to return at once
+            pending.exchange(false, std::memory_order_acq_rel);
+            while(in.size() >= block){
+                in.pop(source);
+                samples = source;
+                convolver.process(samples.data());
+                float d = dry.load(std::memory_order_relaxed), w = wet.load(std::memory_order_relaxed);
+                for(size_t i = 0; i<block; ++i) samples[i] = source[i]*d + samples[i]*w;
+                out.push(samples);
+            }
+        }
+    }
+};
+
+//a stand in for a recorded body response: a few strong low modes of a guitar like box
+//and a dense cloud of weaker, faster decaying ones above them.
+//scaled so that no frequency is amplified
+inline std::vector<float> bodyResponse(float sampleRate, float seconds = 1.f){
+    struct Mode{
+        float frequency, decay, gain;
+    };
+    std::vector<Mode> modes = {
+        {98, 0.25f, 1}, {204, 0.18f, 0.8f}, {282, 0.1f, 0.5f},
+        {396, 0.08f, 0.5f}, {552, 0.06f, 0.3f}, {810, 0.04f, 0.25f}};
+    std::mt19937 state(7);
+    std::uniform_real_distribution<float> unit(0, 1);
+    for(uint k = 0; k<80; ++k)
+        modes.push_back({900*pow(10.f, unit(state)), 0.01f + 0.03f*unit(state), 0.15f*unit(state)});
+
+    std::vector<float> response(size_t(seconds*sampleRate), 0.f);
+    for(const Mode& m : modes){
+        float phase = unit(state)*float(2*M_PI);
+        for(size_t i = 0; i<response.size(); ++i){
+            float t = float(i)/sampleRate;
+            response[i] += m.gain*exp(-t/m.decay)*sin(float(2*M_PI)*m.frequency*t + phase);
+        }
+    }
+
+    size_t n = 4;
+    while(n < response.size()) n *= 2;
+    RealFFT fft(n);
+    std::vector<float> padded(n, 0.f), re(fft.bins()), im(fft.bins());
+    std::copy(response.begin(), response.end(), padded.begin());
+    fft.forward(padded.data(), re.data(), im.data());
+    float peak = 0;
+    for(size_t k = 0; k<re.size(); ++k) peak = std::max(peak, sqrt(re[k]*re[k] + im[k]*im[k]));
+    if(peak > 0) for(float& r : response) r /= peak;
+    return response;
+}
@@ -216,6 +216,10 @@ public:
     vec2 getWorldMousePos() const{
         return wToScreen.antitransform(win.get_mouse_coordinates());
     }
+    //world position of a point on the screen, such as that of a mouse event
+    vec2 screenToWorld(vec2 p) const{
+        return wToScreen.antitransform(p);
+    }
     bool mouseRight() const{
         return win.is_right_mouse_button_down();
     }
@@ -380,6 +384,13 @@ struct PinableFrame : ScaleableFrame{
     vec2 localMousePosition(const DrawableEnvironment& src) const{
         return screenCast(foot, {{0,0},{1,1}})*src.getWorldMousePos();
     }
+    //localMousePosition and localHeld for a mouse event at screen position p, with the left button down or not
+    vec2 localPosition(const DrawableEnvironment& src, vec2 p) const{
+        return screenCast(foot, {{0,0},{1,1}})*src.screenToWorld(p);
+    }
+    bool heldAt(const DrawableEnvironment& src, vec2 p, bool leftDown) const{
+        return !draggable && leftDown && foot.contains(src.screenToWorld(p));
+    }
 
     PinableFrame(screen startpos = {{0,0},{100,100}})
         :ScaleableFrame(startpos)
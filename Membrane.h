@@ -0,0 +1,290 @@
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "generators.h"
+#include "mySimd.h"
+#include "myThreads.h"
+
+//the wave equation of String on a rectangular grid of nodes, a drum head fixed along its rim.
+//the curvature of a node is the 5 point stencil 4*y - (left + right + up + down), and drives the same
+//terms as on the string: segmentStiffness, airResistance, elasticFriction, and edgeResistance on the
+//nodes next to the rim. the elastic friction works on the old offsets of the neighbours, so each row
+//only depends on the step before, unlike the Gauss-Seidel friction of SegmentVector strings.
+//a step streams through the rows once, vectorized along each row, keeping a copy of the old row above.
+//tileSteps > 1 steps bands of rows several times while they are in cache, as String::tileSteps does
+//with segments, and threads > 1 splits the rows into one band per thread instead.
+//all three give the same result. floating point only
+template<typename T>
+class Membrane{
+    static_assert(std::is_floating_point_v<T>, "Membrane has no fixed point variant");
+public:
+    //same parameters as String, see generators.h.
+    //a grid is stable for sqrt(2*segmentStiffness)*stepSize < 1, so it needs more steps than a string,
+    //see stableSubsteps. the default step is half a sample at 44100
+    T stepSize = 1.f/88200.f;
+    T segmentStiffness = 1600000000.f;
+    T edgeResistance = 400.f;
+    T airResistance = 0.2f;
+    T elasticFriction = 0.02f;
+    T segmentLength = 1.f;
+
+    //where output() listens, from 0 to 1 across the width and height
+    vec2 pickup = {0.31f, 0.27f};
+
+    //steps per band of tileRows rows in renderBlock, 1 steps the whole grid at a time.
+    //only used with a single thread
+    uint tileSteps = 1;
+    uint tileRows = 16;
+
+    //width and height count the nodes of the fixed rim too
+    Membrane(uint width = 64, uint height = 64, uint threads = 1)
+        :w(std::max(3u, width)), h(std::max(3u, height)),
+        threads(std::clamp(threads, 1u, uint(h-2))), lockstep(this->threads),
+        y(w*h, 0), dy(w*h, 0), scratch(this->threads*2*w, 0), halo(this->threads*2*w, 0)
+    {}
+    Membrane(const Membrane&) = delete;
+    Membrane& operator=(const Membrane&) = delete;
+
+    size_t width() const {return w;}
+    size_t height() const {return h;}
+    uint threadCount() const {return threads;}
+
+    T& offset(size_t x, size_t row) {return y[row*w + x];}
+    T offset(size_t x, size_t row) const {return y[row*w + x];}
+    T& velocity(size_t x, size_t row) {return dy[row*w + x];}
+    T velocity(size_t x, size_t row) const {return dy[row*w + x];}
+
+    StringCoefficients<T> coefficients() const {
+        return foldCoefficients(stepSize, segmentStiffness, segmentLength, airResistance, elasticFriction);
+    }
+
+    //as String::stableSubsteps, with the limits of the 5 point stencil,
+    //whose curvature reaches twice that of a string: sqrt(2*k)*h < 1 and 4*f*h < 1
+    uint stableSubsteps(T sampleTime, T courant = 0.95f) const {
+        StringCoefficients<T> c = coefficients();
+        T wave = sqrt(2*c.stiffness)*sampleTime;
+        T smoothing = 4*c.friction*sampleTime;
+        return std::max(1u, uint(ceil(std::max(wave, smoothing)/courant)));
+    }
+
+    T output() const {
+        return y[pickupIndex()]*10;
+    }
+
+    T stepStroked(const Pick& pick){
+        StringCoefficients<T> c = coefficients();
+        stepRows(1, h-1, rowAt(0), rowAt(h-1), scratch.data(), c);
+        press(pick, 1, h-1);
+        return output();
+    }
+
+    //renders a block of samples, moving the pick from from to to over its substeps*out.size() steps.
+    //the pick's position is on the membrane, from 0 to 1 across its width and height, and its tip
+    //sits at rest height, pushing the nodes under it to the side they are on, as a pick does on a String
+    void renderBlock(std::span<float> out, const Pick& from, const Pick& to, uint substeps = 1){
+        block = Block{out, PickPath(from, to, out.size()*substeps), substeps, coefficients()};
+        if(threads > 1){
+            unusedTaps.resize(std::max(unusedTaps.size(), threads*out.size()));
+            lockstep.run([&](uint t){stepBand(t);});
+        }
+        else if(tileSteps > 1) renderTiled();
+        else renderWithPath(out, block.path, substeps, [&](const Pick& pick){return stepStroked(pick);});
+    }
+
+    //least steps per sample renderStable takes, as on String
+    uint oversampling = 1;
+
+    //as String::renderStable, at least oversampling steps per sample, decimated to sampleRate
+    //and rendered a buffer of stableChunk steps at a time
+    uint renderStable(std::span<float> out, const Pick& from, const Pick& to, T sampleRate){
+        T sampleTime = 1/sampleRate;
+        uint substeps = std::max(stableSubsteps(sampleTime), oversampling);
+        stepSize = sampleTime/T(substeps);
+        decimator.setFactor(substeps);
+        if(oversampled.size() < substeps) oversampled.resize(substeps);
+        size_t chunk = oversampled.size()/substeps;
+        PickPath path(from, to, out.size()*substeps);
+        for(size_t first = 0; first<out.size(); first += chunk){
+            size_t n = std::min(chunk, out.size()-first);
+            std::span<float> taps(oversampled.data(), n*substeps);
+            renderBlock(taps, path.at(first*substeps), path.at((first+n)*substeps));
+            decimator.process(taps, out.subspan(first, n));
+        }
+        return substeps;
+    }
+
+private:
+    static constexpr size_t Lanes = 8;
+    typedef ::Row<T, Lanes> Row;
+
+    struct Block{
+        std::span<float> out;
+        PickPath path;
+        uint substeps;
+        StringCoefficients<T> c;
+    };
+
+    size_t w, h;
+    uint threads;
+    LockstepThreads lockstep;
+    AlignedVector<T> y, dy;
+    //two rows per thread for stepRows, and the old first and last row of each thread's band
+    AlignedVector<T> scratch, halo;
+    //old offsets of the row above each band level in renderTiled
+    AlignedVector<T> carry;
+    Block block = {{}, PickPath({0,0,0}, {0,0,0}, 1), 1, {}};
+    //where the threads whose band does not hold the pickup write their taps
+    std::vector<float> unusedTaps;
+    //taps at the step rate, for renderStable
+    static constexpr size_t stableChunk = 4096;
+    std::vector<float> oversampled = std::vector<float>(stableChunk);
+    PolyphaseDecimator decimator = PolyphaseDecimator(1, 32, 16, stableChunk);
+
+    T* rowAt(size_t row) {return y.data() + row*w;}
+
+    size_t pickupIndex() const {
+        size_t x = std::clamp(size_t(round(pickup.x*float(w-1))), size_t(1), w-2);
+        size_t row = std::clamp(size_t(round(pickup.y*float(h-1))), size_t(1), h-2);
+        return row*w + x;
+    }
+
+
+    //one step of a row from the old offsets of the row above, itself, and the row below.
+    //writes the new offsets and velocities of the nodes between the rim
+    static void stepRow(const T* __restrict up, const T* __restrict mid, const T* __restrict down,
+        T* __restrict out, T* __restrict v, size_t width, const StringCoefficients<T>& c)
+    {
+        size_t x = 1;
+        size_t top = 1 + (width-2)/Lanes*Lanes;
+        for(; x<top; x+=Lanes){
+            Row u, m, d, l, r, dv;
+            loadRow(u, up+x);
+            loadRow(m, mid+x);
+            loadRow(d, down+x);
+            loadRow(l, mid+x-1);
+            loadRow(r, mid+x+1);
+            loadRow(dv, v+x);
+            Row J = m*T(4) - (u+d+l+r);
+            dv -= J*c.stiffnessStep;
+            dv -= dv*c.airStep;
+            storeRow(v+x, dv);
+            storeRow(out+x, m - J*c.frictionStep + dv*c.step);
+        }
+        for(; x<width-1; ++x){
+            T J = mid[x]*4 - (up[x]+down[x]+mid[x-1]+mid[x+1]);
+            T dv = v[x] - J*c.stiffnessStep;
+            dv -= dv*c.airStep;
+            v[x] = dv;
+            out[x] = mid[x] - J*c.frictionStep + dv*c.step;
+        }
+    }
+
+    //edgeResistance on the nodes of a row next to the rim
+    void dampEdges(size_t row, const StringCoefficients<T>& c){
+        T* p = rowAt(row);
+        T loss = edgeResistance*c.step;
+        if(row == 1 || row == h-2){
+            for(size_t x = 1; x<w-1; ++x) p[x] -= p[x]*loss;
+        }
+        else{
+            p[1] -= p[1]*loss;
+            p[w-2] -= p[w-2]*loss;
+        }
+    }
+
+    //steps rows [lo, hi) once. above holds the old offsets of row lo-1 and below those of row hi,
+    //the rows in between are read from the grid before they are overwritten.
+    //returns the old offsets of row hi-1, kept in the two rows of rows
+    const T* stepRows(size_t lo, size_t hi, const T* above, const T* below, T* rows, const StringCoefficients<T>& c){
+        const T* up = above;
+        T* saved = rows;
+        T* spare = rows+w;
+        for(size_t r = lo; r<hi; ++r){
+            T* row = rowAt(r);
+            memcpy(saved, row, w*sizeof(T));
+            stepRow(up, saved, r+1 == hi ? below : row+w, row, dy.data() + r*w, w, c);
+            dampEdges(r, c);
+            up = saved;
+            std::swap(saved, spare);
+        }
+        return up;
+    }
+
+    //the pick on the nodes of rows [lo, hi) under its tip, at least the one nearest to it
+    void press(const Pick& pick, size_t lo, size_t hi){
+        if(!pick.active) return;
+        float cx = pick.pos.x*float(w-1);
+        float cy = pick.pos.y*float(h-1);
+        float reach = std::max(pick.radius*float(w-1), 0.71f);
+        size_t r0 = std::max(lo, size_t(std::max(0.f, ceil(cy-reach))));
+        size_t r1 = std::min(hi, size_t(std::max(0.f, floor(cy+reach)+1)));
+        size_t x0 = std::max(size_t(1), size_t(std::max(0.f, ceil(cx-reach))));
+        size_t x1 = std::min(w-1, size_t(std::max(0.f, floor(cx+reach)+1)));
+        Pick tip = {true, {0, 0}, pick.radius};
+        for(size_t r = r0; r<r1; ++r){
+            for(size_t x = x0; x<x1; ++x){
+                float ox = float(x)-cx, oy = float(r)-cy;
+                if(ox*ox + oy*oy <= reach*reach) pickSegment(y[r*w+x], dy[r*w+x], tip);
+            }
+        }
+    }
+
+    //steps of the block in groups of tileSteps. in a group the rows are walked in bands of tileRows,
+    //and each band is stepped once per level, shifted up a row per level, so the row below a band
+    //is always one level ahead of it. the old row above comes from the band before at the same level
+    void renderTiled(){
+        size_t steps = block.out.size()*block.substeps;
+        size_t tap = pickupIndex()/w;
+        size_t bandRows = std::max(1u, tileRows);
+        for(size_t s0 = 0; s0<steps; s0 += tileSteps){
+            size_t levels = std::min(size_t(tileSteps), steps-s0);
+            carry.assign(levels*w, 0);
+            for(size_t a = 1; a < h-1 + levels-1; a += bandRows){
+                for(size_t l = 0; l<levels; ++l){
+                    size_t lo = std::max(size_t(1), a > l ? a-l : 1);
+                    size_t hi = std::min(h-1, a+bandRows > l+1 ? a+bandRows-l : 1);
+                    if(lo >= hi) continue;
+                    T* above = carry.data() + l*w;
+                    const T* old = stepRows(lo, hi, above, rowAt(hi), scratch.data(), block.c);
+                    memcpy(above, old, w*sizeof(T));
+                    size_t s = s0+l+1;
+                    press(block.path.at(s), lo, hi);
+                    if(lo <= tap && tap < hi && s%block.substeps == 0)
+                        block.out[s/block.substeps-1] = float(output());
+                }
+            }
+        }
+    }
+
+    //the rows of thread t, stepped in lockstep with the other threads.
+    //each step first copies the old edge rows of every band, which its neighbours read after the barrier
+    void stepBand(uint t){
+        size_t lo = 1 + (h-2)*t/threads;
+        size_t hi = 1 + (h-2)*(t+1)/threads;
+        size_t tap = pickupIndex()/w;
+        T* top = halo.data() + 2*t*w;
+        T* bottom = top+w;
+        const T* above = t > 0 ? halo.data() + (2*t-1)*w : rowAt(0);
+        const T* below = t+1 < threads ? halo.data() + 2*(t+1)*w : rowAt(h-1);
+        bool listening = lo <= tap && tap < hi;
+        std::span<float> out = listening ? block.out : std::span<float>(unusedTaps).subspan(t*block.out.size(), block.out.size());
+
+        renderWithPath(out, block.path, block.substeps, [&](const Pick& pick){
+            memcpy(top, rowAt(lo), w*sizeof(T));
+            memcpy(bottom, rowAt(hi-1), w*sizeof(T));
+            lockstep.barrier().arriveAndWait();
+
+            stepRows(lo, hi, above, below, scratch.data() + 2*t*w, block.c);
+            press(pick, lo, hi);
+            T sample = listening ? output() : T(0);
+            lockstep.barrier().arriveAndWait();
+            return sample;
+        });
+    }
+};
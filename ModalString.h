@@ -0,0 +1,248 @@
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <span>
+#include <array>
+#include <vector>
+
+#include "generators.h"
+
+//the String of generators.h solved in its eigenbasis instead of segment by segment.
+//with fixed ends the curvature operator is tridiagonal, and its eigenvectors are the discrete sines
+//phi_m(j) = sin(pi*m*j/(size-1)) with eigenvalues 4*sin(pi*m/(2*(size-1)))^2,
+//so every mode m is an independent damped oscillator with amplitude a and velocity b:
+//    a' = b - (elasticFriction*eigenvalue + edge loss)*a
+//    b' = -segmentStiffness*eigenvalue*a - airResistance*b
+//each step applies the exact solution of that system over stepSize, a fixed 2x2 matrix per mode.
+//the edge losses of String only act on the two outermost segments, which couples the modes.
+//here they are approximated by their diagonal, the share of each mode on those segments.
+//only modes below maxFrequency and the nyquist frequency are stepped, so the cost of a step
+//scales with the number of audible modes rather than with the number of segments.
+//the others keep the amplitude they had, the initial stroke included, and sound again once maxFrequency is raised.
+//the default string reaches only 12.7 kHz, so the cutoff is lower than hearing: a pluck a tenth of the
+//length or further in leaves every mode above 10 kHz at least 38 dB below the loudest one at the output,
+//under the harmonics that mask it. that steps 171 of the 298 modes of 300 segments.
+//the losses are too light to cull modes by their decay, even the fastest takes about 2.5 s to fall by 60 dB.
+//the modes are stepped Lanes at a time as vector extension rows, as in StringBank
+template<typename T>
+struct ModalString{
+    static constexpr size_t Lanes = 8;
+    typedef ::Row<T, Lanes> Row;
+
+    //same parameters and defaults as String, see generators.h.
+    //changes take effect at the next step
+    T stepSize = 1.f/44100.f;
+    T segmentStiffness = 1600000000.f;
+    T edgeResistance = 400.f;
+    T airResistance = 0.2f;
+    T elasticFriction = 0.02f;
+
+    //highest mode frequency stepped, in Hz. raise it above 12.7 kHz to step every mode of the default string
+    T maxFrequency = 10000.f;
+
+    ModalString(uint sc = 300)
+        :segments(sc), sine(2*(sc-1)), a(rows(sc-2), 0), b(rows(sc-2), 0)
+    {
+        for(size_t k = 0; k<sine.size(); ++k)
+            sine[k] = T(sin(M_PI*double(k)/double(sc-1)));
+
+        //the same random initial stroke as String, projected onto the modes
+        std::vector<T> y(sc, 0);
+        for(size_t i = 1; i<sc-1; ++i) y[i] = strokeShape(y[i-1], i, sc);
+        for(size_t m = 1; m<sc-1; ++m){
+            T sum = 0;
+            for(size_t j = 1; j<sc-1; ++j) sum += y[j]*mode(m, j);
+            a[m-1] = sum*T(2)/T(sc-1);
+        }
+        tune();
+    }
+
+    size_t size() const {return segments;}
+    size_t modeCount() const {return modes;}
+
+    //value of mode m (counted from 1) at segment j, from the sine table
+    T mode(size_t m, size_t j) const {
+        return sine[(m*j)%sine.size()];
+    }
+
+    T offset(size_t j) const {
+        T y = 0;
+        for(size_t m = 0; m<modes; ++m) y += a[m]*mode(m+1, j);
+        return y;
+    }
+    T velocity(size_t j) const {
+        T v = 0;
+        for(size_t m = 0; m<modes; ++m) v += b[m]*mode(m+1, j);
+        return v;
+    }
+
+    T output() const {
+        Row tap = {}, am, w;
+        for(size_t m = 0; m<modes; m+=Lanes){
+            loadRow(am, a.data()+m);
+            loadRow(w, outputWeight.data()+m);
+            tap += am*w;
+        }
+        return sum(tap);
+    }
+
+    T stepStroked(const Pick& pick){
+        retune();
+        T tap = step(e00.data(), e01.data(), e10.data(), e11.data());
+        if(pick.active){
+            size_t pickx = pickIndex(pick);
+            if(pickx && pickSegment(pickx, pick)) tap = output();
+        }
+        return tap;
+    }
+
+    //lossless step, the counterpart of String::stepNoFriction
+    T stepNoFriction(){
+        retune();
+        return step(f00.data(), f01.data(), f10.data(), f00.data());
+    }
+
+    size_t pickIndex(const Pick& pick) const {
+        return ::pickIndex(pick, segments);
+    }
+
+    //same as String::renderBlock
+    void renderBlock(std::span<float> out, const Pick& from, const Pick& to, uint substeps = 1){
+        renderWithPath(out, PickPath(from, to, out.size()*substeps), substeps,
+            [&](const Pick& pick){return stepStroked(pick);});
+    }
+
+    //offsets of all segments, for drawing. costs segments*modes
+    const std::vector<StringSegment<T>>& shape(){
+        shapeCache.resize(segments);
+        for(size_t j = 0; j<segments; ++j) shapeCache[j] = StringSegment<T>(offset(j), velocity(j));
+        return shapeCache;
+    }
+
+private:
+    size_t segments;
+    size_t modes = 0;
+    //sin(pi*k/(size-1)) over a whole period
+    std::vector<T> sine;
+    //amplitude and velocity of every mode, padded to whole rows with modes that stay zero.
+    //only the first modes are stepped, the rest are held
+    AlignedVector<T> a, b;
+    //per mode step matrices, with and without losses, and output weights of the stepped modes.
+    //the rest of their last row has identity matrices and no weight, so the modes there are held
+    AlignedVector<T> e00, e01, e10, e11;
+    AlignedVector<T> f00, f01, f10;
+    AlignedVector<T> outputWeight;
+    std::array<T, 6> tuned{};
+    std::vector<StringSegment<T>> shapeCache;
+
+    static size_t rows(size_t n){
+        return (n+Lanes-1)/Lanes*Lanes;
+    }
+    static T sum(const Row& r){
+        T s = 0;
+        for(size_t l = 0; l<Lanes; ++l) s += r[l];
+        return s;
+    }
+
+    //advances every mode by one step matrix, and returns the output tap of the new state
+    T step(const T* m00, const T* m01, const T* m10, const T* m11){
+        Row tap = {}, am, bm, c00, c01, c10, c11, w;
+        for(size_t m = 0; m<modes; m+=Lanes){
+            loadRow(am, a.data()+m);
+            loadRow(bm, b.data()+m);
+            loadRow(c00, m00+m);
+            loadRow(c01, m01+m);
+            loadRow(c10, m10+m);
+            loadRow(c11, m11+m);
+            loadRow(w, outputWeight.data()+m);
+            Row na = c00*am + c01*bm;
+            storeRow(a.data()+m, na);
+            storeRow(b.data()+m, c10*am + c11*bm);
+            tap += na*w;
+        }
+        return sum(tap);
+    }
+
+    //collision of the pick with segment j, synthesized from the modes.
+    //the change the pick makes to the segment goes back into the modes as a projected point impulse.
+    //returns whether the pick touched the string
+    bool pickSegment(size_t j, const Pick& pick){
+        T y = offset(j), v = velocity(j);
+        T ny = y, nv = v;
+        ::pickSegment(ny, nv, pick);
+        if(ny == y && nv == v) return false;
+        T norm = T(2)/T(segments-1);
+        T dy = (ny-y)*norm, dv = (nv-v)*norm;
+        for(size_t m = 0; m<modes; ++m){
+            T phi = mode(m+1, j);
+            a[m] += dy*phi;
+            b[m] += dv*phi;
+        }
+        return true;
+    }
+
+    void retune(){
+        std::array<T, 6> now = {stepSize, segmentStiffness, edgeResistance, airResistance, elasticFriction, maxFrequency};
+        if(now != tuned) tune();
+    }
+
+    //recomputes the step matrices from the parameters
+    void tune(){
+        tuned = {stepSize, segmentStiffness, edgeResistance, airResistance, elasticFriction, maxFrequency};
+        double h = stepSize;
+        double n = double(segments-1);
+        double limit = std::min(double(maxFrequency), 0.5/h);
+
+        size_t kept = 0;
+        while(kept < segments-2){
+            double eigen = 4*pow(sin(M_PI*double(kept+1)/(2*n)), 2);
+            if(sqrt(segmentStiffness*eigen)/(2*M_PI) >= limit) break;
+            ++kept;
+        }
+        modes = kept;
+
+        for(AlignedVector<T>* v : {&e00, &e01, &e10, &e11, &f00, &f01, &f10, &outputWeight}) v->assign(rows(modes), 0);
+        for(size_t m = modes; m<rows(modes); ++m) e00[m] = e11[m] = f00[m] = 1;
+        for(size_t m = 0; m<modes; ++m){
+            double eigen = 4*pow(sin(M_PI*double(m+1)/(2*n)), 2);
+            double w2 = segmentStiffness*eigen;
+            //share of this mode on the two damped edge segments
+            double edge = edgeResistance*(pow(mode(m+1, 1), 2) + pow(mode(m+1, segments-2), 2))*2/n;
+            double g = elasticFriction*eigen + edge;
+            double r = airResistance;
+            expStep(g, r, w2, h, e00[m], e01[m], e10[m], e11[m]);
+            T f11;
+            expStep(0, 0, w2, h, f00[m], f01[m], f10[m], f11);
+            outputWeight[m] = (mode(m+1, 1) - mode(m+1, segments-2))*10;
+        }
+    }
+
+    //exp(h*A) for A = {{-g, 1}, {-w2, -r}}, written as exp(s*h)*(c*I + d*(A - s*I))
+    //with s the mean of the eigenvalues of A
+    static void expStep(double g, double r, double w2, double h, T& m00, T& m01, T& m10, T& m11){
+        double s = -(g+r)/2;
+        double disc = (g-r)*(g-r)/4 - w2;
+        double c, d;
+        if(disc < 0){
+            double w = sqrt(-disc);
+            c = cos(w*h);
+            d = sin(w*h)/w;
+        }
+        else if(disc > 0){
+            double q = sqrt(disc);
+            c = cosh(q*h);
+            d = sinh(q*h)/q;
+        }
+        else{
+            c = 1;
+            d = h;
+        }
+        double e = exp(s*h);
+        m00 = T(e*(c + d*(r-g)/2));
+        m01 = T(e*d);
+        m10 = T(-e*d*w2);
+        m11 = T(e*(c + d*(g-r)/2));
+    }
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "generators.h"
+#include "myThreads.h"
+
+//a single long string stepped by several threads, each owning a contiguous chunk of segments.
+//a step runs in two phases split by a SpinBarrier: every thread computes the curvature of its chunk,
+//then updates velocities and positions from it. the only data crossing a chunk boundary is the
+//one segment halo of offsets and the two curvatures before a chunk, read straight from shared memory
+//after the barrier. chunks start on 64 segment boundaries, so every segment takes the same simd path
+//as in a single threaded SegmentArrays step, and the output matches it exactly while the whole string is active.
+//a sleeping string stays asleep through blocks the pick does not touch. otherwise every segment is stepped,
+//so the string is woken with all of it active, and it is never put to sleep from here
+template<typename T>
+class ParallelString{
+public:
+    String<T, SegmentArrays<T>> string;
+
+    ParallelString(uint threads = std::max(1u, std::thread::hardware_concurrency()))
+        :threads(std::max(1u, threads)), lockstep(this->threads)
+    {}
+    ParallelString(const ParallelString&) = delete;
+    ParallelString& operator=(const ParallelString&) = delete;
+
+    uint threadCount() const {return threads;}
+
+    //same as String::renderBlock
+    void renderBlock(std::span<float> out, const Pick& from, const Pick& to, uint substeps = 1){
+        if(string.asleep && !(from.active && to.active)){
+            std::fill(out.begin(), out.end(), 0.f);
+            string.lastPicks.clear();
+            return;
+        }
+        string.wake();
+        Pick first = string.lastPicks.empty() ? Pick{false, {0, 0}, 0} : string.lastPicks[0];
+        block = Block{out, PickPath(from, to, out.size()*substeps), first, substeps, string.coefficients()};
+        splitChunks();
+        unusedTaps.resize(std::max(unusedTaps.size(), (threads-1)*out.size()));
+        lockstep.run([&](uint t){stepChunk(t);});
+        string.lastPicks.assign(1, block.path.at(out.size()*substeps));
+    }
+
+private:
+    struct Block{
+        std::span<float> out;
+        PickPath path;
+        //the pick of the step before the block, where the first step sweeps from
+        Pick first;
+        uint substeps;
+        StringCoefficients<T> c;
+    };
+
+    uint threads;
+    LockstepThreads lockstep;
+    std::vector<size_t> bounds;
+    //where the threads but the first write the taps they do not report
+    std::vector<float> unusedTaps;
+    Block block = {{}, PickPath({0,0,0}, {0,0,0}, 1), {0,0,0}, 1, {}};
+
+    void splitChunks(){
+        size_t n = string.size();
+        bounds.resize(threads+1);
+        for(uint t = 0; t<threads; ++t)
+            bounds[t] = std::min(n-1, 1 + (n-2)*t/threads/64*64);
+        bounds[threads] = n-1;
+    }
+
+    void stepChunk(uint t){
+        const StringKernelTable<T>& k = stringKernels<T>();
+        size_t n = string.size();
+        size_t lo = bounds[t];
+        size_t hi = bounds[t+1];
+        T* y = string.y.data();
+        T* dy = string.dy.data();
+        T* J = string.curvature.data()+2;
+        std::span<float> out = t == 0 ? block.out : std::span<float>(unusedTaps).subspan((t-1)*block.out.size(), block.out.size());
+        //the pick of the step before, where the pick's sweep starts
+        Pick previous = block.first;
+
+        renderWithPath(out, block.path, block.substeps, [&](const Pick& pick){
+            k.curvature(y, J, lo, hi);
+            if(t == 0){
+                J[0] = 0;
+                J[-1] = 0;
+            }
+            lockstep.barrier().arriveAndWait();
+
+            k.strokeVelocities(y, dy, J, lo, hi, block.c);
+            //the part of the pick's sweep over this chunk, as in String::contact
+            PickSweep sweep(previous, pick, n);
+            previous = pick;
+            for(size_t j = std::max(sweep.lo, lo); j<std::min(sweep.hi+1, hi); ++j){
+                float enter, exit;
+                sweep.heights(j, enter, exit);
+                sweptPickSegment(y[j], dy[j], enter, exit, sweep.radius, string.velocityUnit());
+            }
+            k.integrate(y, dy, lo, hi, block.c);
+            if(lo <= 1 && 1 < hi) string.dampEdge(1);
+            if(lo <= n-2 && n-2 < hi) string.dampEdge(n-2);
+            lockstep.barrier().arriveAndWait();
+            return t == 0 ? string.output() : T(0);
+        });
+    }
+};
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "generators.h"
+#include "mySimd.h"
+#include "myThreads.h"
+
+//strings of segments joined into a graph, such as several strings ending on a shared bridge.
+//every segment is a node, and the springs between them are the edges of a weighted graph,
+//kept as a compressed sparse row (CSR) matrix: the neighbours of node i are column[rowStart[i]] up to
+//column[rowStart[i+1]], with the spring weights alongside. the curvature of a node is
+//    J[i] = sum over its neighbours j of weight*(y[i] - y[j])
+//which is 2*y[i] - y[i-1] - y[i+1] inside a string, as in String. a node's mass divides the stiffness
+//and elastic friction acting on it, so a heavy bridge moves little and passes the vibration of one
+//string on to the others. fixed nodes have no mobility at all, and the nodes next to them take edgeResistance.
+//a step is one sweep over the sparse rows for the curvatures, and one elementwise sweep for the
+//velocities and offsets, so its cost is linear in the number of segments. nodes are numbered along
+//each string, so the rows read offsets that are next to each other in memory.
+//threads > 1 splits the nodes into one contiguous chunk per thread, with a SpinBarrier between the sweeps.
+//the elastic friction works on the old offsets, as in Membrane, so any split gives the same result.
+//floating point only
+template<typename T>
+class StringNetwork{
+    static_assert(std::is_floating_point_v<T>, "StringNetwork has no fixed point variant");
+public:
+    //same parameters and defaults as String, see generators.h
+    T stepSize = 1.f/44100.f;
+    T segmentStiffness = 1600000000.f;
+    T edgeResistance = 400.f;
+    T airResistance = 0.2f;
+    T elasticFriction = 0.02f;
+    T segmentLength = 1.f;
+
+    StringNetwork(uint threads = 1)
+        :threads(std::max(1u, threads)), lockstep(this->threads)
+    {}
+    StringNetwork(const StringNetwork&) = delete;
+    StringNetwork& operator=(const StringNetwork&) = delete;
+
+    //a node on its own, at rest. a fixed node never moves, a free one moves as a segment of the given mass
+    size_t addNode(T mass = 1, bool fixed = false){
+        y.push_back(0);
+        dy.push_back(0);
+        mobility.push_back(fixed ? T(0) : 1/mass);
+        edge.push_back(0);
+        dirty = true;
+        return y.size()-1;
+    }
+
+    //a spring between two nodes, weight times as stiff as the one between two segments of a string
+    void connect(size_t a, size_t b, T weight = 1){
+        links.push_back({a, b, weight});
+        dirty = true;
+    }
+
+    //a string of segments nodes counting both ends, as String(segments), from node from to node to.
+    //ends left at SIZE_MAX get a new fixed node. returns the index of the string
+    uint addString(uint segments, size_t from = SIZE_MAX, size_t to = SIZE_MAX){
+        segments = std::max(3u, segments);
+        if(from == SIZE_MAX) from = addNode(1, true);
+        size_t first = y.size();
+        for(size_t i = 1; i<segments-1; ++i) addNode();
+        if(to == SIZE_MAX) to = addNode(1, true);
+        connect(from, first);
+        for(size_t i = first; i+1<first+segments-2; ++i) connect(i, i+1);
+        connect(first+segments-3, to);
+        strings.push_back({first, segments, from, to});
+        return uint(strings.size()-1);
+    }
+
+    size_t nodeCount() const {return y.size();}
+    size_t stringCount() const {return strings.size();}
+    uint threadCount() const {return threads;}
+    size_t size(uint string) const {return strings[string].segments;}
+
+    //node of segment i of a string, as numbered in String
+    size_t node(uint string, size_t i) const {
+        const Strand& s = strings[string];
+        return i == 0 ? s.from : i == s.segments-1 ? s.to : s.first+i-1;
+    }
+    T& offset(size_t n) {return y[n];}
+    T offset(size_t n) const {return y[n];}
+    T& velocity(size_t n) {return dy[n];}
+    T velocity(size_t n) const {return dy[n];}
+
+    StringCoefficients<T> coefficients() const {
+        return foldCoefficients(stepSize, segmentStiffness, segmentLength, airResistance, elasticFriction);
+    }
+
+    //same as String::output for one string
+    T output(uint string) const {
+        return (y[node(string, 1)] - y[node(string, size(string)-2)])*10;
+    }
+    //all strings together
+    T output() const {
+        T sum = 0;
+        for(uint s = 0; s<strings.size(); ++s) sum += output(s);
+        return sum;
+    }
+
+    //one step, with the pick on a string. pick.pos.x runs along the string, as on a String
+    T stepStroked(const Pick& pick, uint string){
+        build();
+        StringCoefficients<T> c = coefficients();
+        curvatures(0, y.size());
+        update(0, y.size(), c);
+        press(pick, string, 0, y.size());
+        return output();
+    }
+
+    //renders a block of samples of output(), moving the pick on a string from from to to
+    //over its substeps*out.size() steps
+    void renderBlock(std::span<float> out, const Pick& from, const Pick& to, uint string, uint substeps = 1){
+        build();
+        block = Block{out, PickPath(from, to, out.size()*substeps), string, substeps, coefficients()};
+        if(threads > 1){
+            unusedTaps.resize(std::max(unusedTaps.size(), (threads-1)*out.size()));
+            lockstep.run([&](uint t){stepChunk(t);});
+        }
+        else renderWithPath(out, block.path, substeps, [&](const Pick& pick){return stepStroked(pick, string);});
+    }
+
+private:
+    struct Strand{
+        size_t first;
+        size_t segments;
+        size_t from, to;
+    };
+    struct Link{
+        size_t a, b;
+        T weight;
+    };
+    struct Block{
+        std::span<float> out;
+        PickPath path;
+        uint string;
+        uint substeps;
+        StringCoefficients<T> c;
+    };
+
+    uint threads;
+    LockstepThreads lockstep;
+
+    AlignedVector<T> y, dy, J;
+    //inverse mass of each node, 0 when fixed
+    AlignedVector<T> mobility;
+    //1 for the nodes next to a fixed one
+    AlignedVector<T> edge;
+    std::vector<Strand> strings;
+    std::vector<Link> links;
+
+    //the CSR matrix, and the sum of the weights of each row
+    std::vector<uint32_t> rowStart;
+    std::vector<uint32_t> column;
+    std::vector<T> weight;
+    AlignedVector<T> diagonal;
+    bool dirty = true;
+
+    Block block = {{}, PickPath({0,0,0}, {0,0,0}, 1), 0, 1, {}};
+    //where the threads but the first write the taps they do not report
+    std::vector<float> unusedTaps;
+
+    //rebuilds the CSR matrix from the links after nodes or links were added
+    void build(){
+        if(!dirty) return;
+        dirty = false;
+        size_t n = y.size();
+        rowStart.assign(n+1, 0);
+        for(const Link& l : links){
+            ++rowStart[l.a+1];
+            ++rowStart[l.b+1];
+        }
+        for(size_t i = 0; i<n; ++i) rowStart[i+1] += rowStart[i];
+        column.resize(rowStart[n]);
+        weight.resize(rowStart[n]);
+        diagonal.assign(n, 0);
+        std::vector<uint32_t> fill(rowStart.begin(), rowStart.end()-1);
+        for(const Link& l : links){
+            column[fill[l.a]] = uint32_t(l.b);
+            weight[fill[l.a]++] = l.weight;
+            column[fill[l.b]] = uint32_t(l.a);
+            weight[fill[l.b]++] = l.weight;
+            diagonal[l.a] += l.weight;
+            diagonal[l.b] += l.weight;
+        }
+        //neighbours in ascending order, so a row reads memory front to back
+        for(size_t i = 0; i<n; ++i){
+            std::vector<std::pair<uint32_t, T>> row;
+            for(uint32_t k = rowStart[i]; k<rowStart[i+1]; ++k) row.push_back({column[k], weight[k]});
+            std::sort(row.begin(), row.end(), [](const auto& a, const auto& b){return a.first < b.first;});
+            for(uint32_t k = rowStart[i]; k<rowStart[i+1]; ++k){
+                column[k] = row[k-rowStart[i]].first;
+                weight[k] = row[k-rowStart[i]].second;
+            }
+        }
+        for(size_t i = 0; i<n; ++i){
+            bool nearFixed = false;
+            for(uint32_t k = rowStart[i]; k<rowStart[i+1]; ++k) nearFixed |= mobility[column[k]] == 0;
+            edge[i] = mobility[i] != 0 && nearFixed ? T(1) : T(0);
+        }
+        J.assign(n, 0);
+    }
+
+    //the sparse sweep, reads the offsets of every neighbour
+    void curvatures(size_t lo, size_t hi){
+        for(size_t i = lo; i<hi; ++i){
+            T sum = 0;
+            for(uint32_t k = rowStart[i]; k<rowStart[i+1]; ++k) sum += weight[k]*y[column[k]];
+            J[i] = diagonal[i]*y[i] - sum;
+        }
+    }
+
+    //the elementwise sweep, velocities and offsets from the curvatures
+    void update(size_t lo, size_t hi, const StringCoefficients<T>& c){
+        T* __restrict py = y.data();
+        T* __restrict pdy = dy.data();
+        const T* __restrict pJ = J.data();
+        const T* __restrict pm = mobility.data();
+        const T* __restrict pe = edge.data();
+        T loss = edgeResistance*c.step;
+        for(size_t i = lo; i<hi; ++i){
+            T v = pdy[i] - pJ[i]*pm[i]*c.stiffnessStep;
+            v -= v*c.airStep;
+            pdy[i] = v;
+            T next = py[i] - pJ[i]*pm[i]*c.frictionStep + v*c.step;
+            py[i] = next - next*pe[i]*loss;
+        }
+    }
+
+    //the pick on the one segment of a string under it, if that segment lies in nodes [lo, hi)
+    void press(const Pick& pick, uint string, size_t lo, size_t hi){
+        if(!pick.active || string >= strings.size()) return;
+        size_t i = pickIndex(pick, size(string));
+        if(!i) return;
+        size_t n = node(string, i);
+        if(lo <= n && n < hi && mobility[n] != 0) pickSegment(y[n], dy[n], pick);
+    }
+
+    //the nodes of thread t, stepped in lockstep with the other threads
+    void stepChunk(uint t){
+        size_t n = y.size();
+        size_t lo = n*t/threads;
+        size_t hi = n*(t+1)/threads;
+        std::span<float> out = t == 0 ? block.out : std::span<float>(unusedTaps).subspan((t-1)*block.out.size(), block.out.size());
+
+        renderWithPath(out, block.path, block.substeps, [&](const Pick& pick){
+            curvatures(lo, hi);
+            lockstep.barrier().arriveAndWait();
+
+            update(lo, hi, block.c);
+            press(pick, block.string, lo, hi);
+            lockstep.barrier().arriveAndWait();
+            return t == 0 ? output() : T(0);
+        });
+    }
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "generators.h"
+#include "myThreads.h"
+
+//many independent String voices rendered in parallel on a WorkStealingPool.
+//each audio block renders every voice into its own buffer, then mixes the buffers.
+//the mix adds voices in index order for every sample, whichever thread does the adding,
+//so the output is bit identical for any number of threads
+template<typename T, typename Layout = SegmentArrays<T>>
+class VoiceEngine{
+public:
+    struct Voice{
+        String<T, Layout> string;
+        //the pick at the start and the end of the next block
+        Pick from = {0,0,0};
+        Pick to = {0,0,0};
+        std::vector<float> buffer;
+    };
+
+    //steps per output sample, passed on to String::renderBlock
+    uint substeps = 1;
+    //samples summed per mixing task
+    size_t mixChunk = 256;
+
+    VoiceEngine(uint threads = std::max(1u, std::thread::hardware_concurrency()))
+        :pool(threads){}
+
+    //adds a voice with the default string, returning it for tuning.
+    //references to earlier voices stay valid until the next call
+    String<T, Layout>& addVoice(){
+        voices.emplace_back();
+        return voices.back().string;
+    }
+    size_t voiceCount() const {return voices.size();}
+    Voice& voice(size_t i){return voices[i];}
+    uint threadCount() const {return pool.threadCount();}
+
+    //the pick a voice moves toward over the next block
+    void setPick(size_t voice, const Pick& pick){
+        voices[voice].to = pick;
+    }
+
+    void render(std::span<float> out){
+        for(Voice& v : voices) v.buffer.resize(out.size());
+
+        pool.run(voices.size(), [&](size_t i){
+            Voice& v = voices[i];
+            v.string.renderBlock(v.buffer, v.from, v.to, substeps);
+            v.from = v.to;
+        });
+
+        size_t chunks = (out.size()+mixChunk-1)/mixChunk;
+        pool.run(chunks, [&](size_t c){
+            size_t end = std::min(out.size(), (c+1)*mixChunk);
+            for(size_t j = c*mixChunk; j<end; ++j){
+                float samp = 0;
+                for(const Voice& v : voices) samp += v.buffer[j];
+                out[j] = samp;
+            }
+        });
+    }
+
+private:
+    std::vector<Voice> voices;
+    WorkStealingPool pool;
+};
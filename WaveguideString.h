@@ -0,0 +1,257 @@
+#pragma once
+
+#include <math.h>
+#include <algorithm>
+#include <array>
+#include <complex>
+#include <span>
+#include <vector>
+
+#include "generators.h"
+
+//the String of generators.h as a digital waveguide: two delay lines carry the right and left going
+//halves of the displacement between the fixed ends, which reflect them with inverted sign.
+//the waves travel about sqrt(segmentStiffness)*stepSize segments per step, which sets the length of the lines.
+//all losses and the dispersion are lumped into filters at the right end:
+//    a one pole lowpass for the losses. airResistance damps every frequency alike,
+//        elasticFriction and edgeResistance damp like the modes of the string, growing with frequency squared
+//    a chain of first order allpasses for the dispersion. the finite segments of String make its partials
+//        go flat with frequency, matched here at partial dispersionPartial
+//    a first order allpass for the fractional part of the loop length, tuned at the fundamental
+//a step costs the same for any number of segments. the pick only pushes the displacement at its position,
+//and does not halve the velocity there as String does
+template<typename T>
+struct WaveguideString{
+    //same parameters and defaults as String, see generators.h.
+    //changes take effect at the next step, but a new loop length restarts the waves from silence
+    T stepSize = 1.f/44100.f;
+    T segmentStiffness = 1600000000.f;
+    T edgeResistance = 400.f;
+    T airResistance = 0.2f;
+    T elasticFriction = 0.02f;
+
+    static constexpr uint dispersionStages = 4;
+    static constexpr double dispersionPartial = 12;
+
+    WaveguideString(uint sc = 300)
+        :segments(sc)
+    {
+        tune();
+        //the same random initial stroke as String, at rest, so it splits evenly between the two lines
+        std::vector<T> y(sc, 0);
+        for(size_t i = 1; i<sc-1; ++i) y[i] = strokeShape(y[i-1], i, sc);
+        for(size_t x = 0; x<rail; ++x){
+            double at = std::min((double(x)+0.5)/railPerSegment, double(sc-1));
+            size_t i = std::min(size_t(at), size_t(sc-2));
+            double f = at-double(i);
+            T half = T((y[i]*(1-f) + y[i+1]*f)/2);
+            rightAt(x) = half;
+            leftAt(x) = half;
+        }
+    }
+
+    size_t size() const {return segments;}
+    //length of each delay line in steps
+    size_t railLength() const {return rail;}
+
+    //displacement of segment i, interpolated between the two nearest points of the delay lines
+    T offset(size_t i) const {
+        double at = std::clamp(railPosition(i), 0., double(rail-1));
+        size_t x = std::min(size_t(at), rail-2);
+        T f = T(at-double(x));
+        return (rightAt(x) + leftAt(x))*(1-f) + (rightAt(x+1) + leftAt(x+1))*f;
+    }
+
+    T output() const {
+        return (offset(1)-offset(segments-2))*10;
+    }
+
+    T stepStroked(const Pick& pick){
+        retune();
+        advance(true);
+        if(pick.active){
+            size_t pickx = pickIndex(pick);
+            if(pickx) pickSegment(pickx, pick);
+        }
+        return output();
+    }
+
+    //lossless step, the counterpart of String::stepNoFriction.
+    //it keeps the dispersion and tuning filters, so the pitch does not change
+    T stepNoFriction(){
+        retune();
+        advance(false);
+        return output();
+    }
+
+    size_t pickIndex(const Pick& pick) const {
+        return ::pickIndex(pick, segments);
+    }
+
+    //same as String::renderBlock
+    void renderBlock(std::span<float> out, const Pick& from, const Pick& to, uint substeps = 1){
+        renderWithPath(out, PickPath(from, to, out.size()*substeps), substeps,
+            [&](const Pick& pick){return stepStroked(pick);});
+    }
+
+    //offsets of all segments, for drawing
+    const std::vector<StringSegment<T>>& shape(){
+        shapeCache.resize(segments);
+        for(size_t i = 0; i<segments; ++i) shapeCache[i] = StringSegment<T>(offset(i), 0);
+        return shapeCache;
+    }
+
+private:
+    size_t segments;
+    //steps of travel per segment at the fundamental
+    double railPerSegment = 1;
+    //both lines hold rail steps of travel. head is the oldest sample of each,
+    //which is the one reaching the far end on the next step
+    size_t rail = 0;
+    size_t head = 0;
+    std::vector<T> right, left;
+
+    //loop filters, with their state
+    T lossGain = 1, lossPole = 0, lossState = 0;
+    T dispersion = 0;
+    std::array<T, dispersionStages> dispersionIn{}, dispersionOut{};
+    T tuning = 0, tuningIn = 0, tuningOut = 0;
+
+    std::array<T, 5> tuned{};
+    std::vector<StringSegment<T>> shapeCache;
+
+    //the right going wave x steps from the left end, and the left going wave at the same point
+    T& rightAt(size_t x){return right[wrap(head+rail-1-x)];}
+    T& leftAt(size_t x){return left[wrap(head+x)];}
+    const T& rightAt(size_t x) const {return right[wrap(head+rail-1-x)];}
+    const T& leftAt(size_t x) const {return left[wrap(head+x)];}
+    //index into a line from one below twice its length, without a division
+    size_t wrap(size_t i) const {return i >= rail ? i-rail : i;}
+
+    //point of the delay lines at segment i.
+    //a wave leaving the left line enters the right one a step later, so the left end sits half a step before 0.
+    //the right end is as far beyond the last point as the loop filters delay the fundamental
+    double railPosition(size_t i) const {
+        return double(i)*railPerSegment - 0.5;
+    }
+    size_t railIndex(size_t i) const {
+        return size_t(std::clamp(lround(railPosition(i)), 0l, long(rail-1)));
+    }
+
+    void advance(bool lossy){
+        T atRight = right[head];
+        T atLeft = left[head];
+
+        T w = atRight;
+        if(lossy){
+            lossState = lossGain*(1+lossPole)*w - lossPole*lossState;
+            w = lossState;
+        }
+        for(uint s = 0; s<dispersionStages; ++s){
+            T o = dispersion*w + dispersionIn[s] - dispersion*dispersionOut[s];
+            dispersionIn[s] = w;
+            dispersionOut[s] = o;
+            w = o;
+        }
+        T o = tuning*w + tuningIn - tuning*tuningOut;
+        tuningIn = w;
+        tuningOut = o;
+
+        right[head] = -atLeft;
+        left[head] = -o;
+        head = wrap(head+1);
+    }
+
+    //moves the displacement at segment i to where the pick puts it, pushing both waves alike
+    void pickSegment(size_t i, const Pick& pick){
+        size_t x = railIndex(i);
+        T y = rightAt(x) + leftAt(x);
+        T ny = y, v = 0;
+        ::pickSegment(ny, v, pick);
+        T push = (ny-y)/2;
+        rightAt(x) += push;
+        leftAt(x) += push;
+    }
+
+    void retune(){
+        std::array<T, 5> now = {stepSize, segmentStiffness, edgeResistance, airResistance, elasticFriction};
+        if(now != tuned) tune();
+    }
+
+    //phase delay in steps of a filter with response r at angular frequency w (radians per step)
+    static double phaseDelay(std::complex<double> r, double w){
+        return -std::arg(r)/w;
+    }
+    static std::complex<double> allpass(double a, double w){
+        std::complex<double> z = std::polar(1., -w);
+        return (a + z)/(1. + a*z);
+    }
+
+    //loop delay in steps at which partial m of String closes on itself.
+    //its modes are at 2*c*sin(pi*m/(2*n)) radians per second, c = sqrt(segmentStiffness), n = segments-1
+    double stringLoopDelay(double m, double& w) const {
+        double n = double(segments-1);
+        w = 2*sqrt(double(segmentStiffness))*sin(M_PI*m/(2*n))*double(stepSize);
+        return 2*M_PI*m/w;
+    }
+
+    void tune(){
+        tuned = {stepSize, segmentStiffness, edgeResistance, airResistance, elasticFriction};
+        double h = stepSize;
+        double c = sqrt(double(segmentStiffness));
+        double n = double(segments-1);
+
+        double w1, wd;
+        double loop1 = stringLoopDelay(1, w1);
+        double loopd = stringLoopDelay(std::min(dispersionPartial, n/2), wd);
+
+        //losses per second at angular frequency w, as for the modes of ModalString
+        auto damping = [&](double w){
+            double eigen = (w/c)*(w/c);
+            return airResistance/2 + (elasticFriction + 4*edgeResistance/n)*eigen/2;
+        };
+        //one pole lowpass with the round trip gain of the fundamental at dc,
+        //and the right ratio to it at a quarter of the sample rate
+        double wq = M_PI/2;
+        double g0 = exp(-damping(w1/h)*loop1*h);
+        double rho = std::min(exp(-(damping(wq/h)-damping(w1/h))*loop1*h), 1.);
+        double pole = 0;
+        if(rho < 1){
+            //(1+a)^2 = rho^2*(1 + 2a*cos(wq) + a^2), the root in (-1, 0]
+            double qa = 1-rho*rho, qb = 2*(1-rho*rho*cos(wq));
+            pole = (-qb + sqrt(qb*qb - 4*qa*qa))/(2*qa);
+        }
+        lossGain = T(g0);
+        lossPole = T(pole);
+        auto lossResponse = [&](double w){
+            return (1+pole)/(1. + pole*std::polar(1., -w));
+        };
+
+        //the allpass coefficient whose chain adds the extra delay String has at partial dispersionPartial
+        double want = loopd-loop1;
+        double lo = 0, hi = 0.95;
+        auto extra = [&](double a){
+            return dispersionStages*(phaseDelay(allpass(a, wd), wd) - phaseDelay(allpass(a, w1), w1));
+        };
+        if(extra(hi) <= want) lo = hi;
+        for(int k = 0; k<50 && lo < hi; ++k){
+            double mid = (lo+hi)/2;
+            (extra(mid) < want ? lo : hi) = mid;
+        }
+        dispersion = T(lo);
+
+        //what is left of the loop at the fundamental goes to the two lines and the tuning allpass
+        double rest = loop1 - phaseDelay(lossResponse(w1), w1) - dispersionStages*phaseDelay(allpass(lo, w1), w1);
+        size_t length = size_t(std::max(1., floor((rest-0.5)/2)));
+        double d = rest - 2*double(length);
+        tuning = T((1-d)/(1+d));
+        railPerSegment = loop1/2/n;
+
+        if(length != rail){
+            rail = length;
+            head = 0;
+            right.assign(rail, 0);
+            left.assign(rail, 0);
+        }
+    }
+};
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "myAudioUtilities.h"
+
+//plays a known block through AudioStream on SDL's disk driver, and checks that it reaches the file
+//in SDL_DISKAUDIOFILE unchanged. before the block the stream holds silence, after it the last sample
+//until the stream closes.
+//run by meson test, which sets SDL_AUDIODRIVER=disk
+int main(){
+    const char* path = getenv("SDL_DISKAUDIOFILE");
+    if(!path){
+        std::cout << "SDL_DISKAUDIOFILE is not set\n";
+        return 1;
+    }
+
+    std::vector<int16_t> block(4410);
+    for(size_t i = 0; i<block.size(); ++i) block[i] = int16_t(1 + int(i*37%20000) - 10000*int(i%2));
+    {
+        AudioStream austr(44100, 512);
+        if(austr.queueSamples(block) != block.size()){
+            std::cout << "the block did not fit in the queue\n";
+            return 1;
+        }
+        //the disk driver plays in real time, give it the block and a few device buffers more
+        for(int wait = 0; wait<200 && austr.getBlockSize() > 0; ++wait)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    FILE* file = fopen(path, "rb");
+    if(!file){
+        std::cout << "no file written to " << path << '\n';
+        return 1;
+    }
+    std::vector<int16_t> written;
+    int16_t sample;
+    while(fread(&sample, sizeof(sample), 1, file) == 1) written.push_back(sample);
+    fclose(file);
+
+    size_t start = 0;
+    while(start < written.size() && written[start] == 0) ++start;
+    if(written.size()-start < block.size()){
+        std::cout << "only " << written.size()-start << " of " << block.size() << " samples written\n";
+        return 1;
+    }
+    for(size_t i = 0; i<block.size(); ++i){
+        if(written[start+i] != block[i]){
+            std::cout << "sample " << i << " is " << written[start+i] << ", queued " << block[i] << '\n';
+            return 1;
+        }
+    }
+    //closing the stream silences the callback, so the file may end in zeros
+    size_t end = written.size();
+    while(end > start+block.size() && written[end-1] == 0) --end;
+    for(size_t i = start+block.size(); i<end; ++i){
+        if(written[i] != block.back()){
+            std::cout << "sample " << i-start << " after the block is " << written[i] << ", not the last one held\n";
+            return 1;
+        }
+    }
+    std::cout << block.size() << " samples written as queued\n";
+    return 0;
+}
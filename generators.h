@@ -1,11 +1,21 @@
 #pragma once
 
 #include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
 #include <vector>
+#include <span>
+#include <array>
 #include <string>
+#include <type_traits>
 #define _USE_MATH_DEFINES
 
 #include "myvecs.h"
+#include "mySimd.h"
+#include "myfixed.h"
+#include "stringKernels.h"
+#include "myDecimator.h"
 
 struct sinusoidalGenerator{
     double phase = 0;
@@ -32,9 +42,392 @@ struct StringSegment{
     StringSegment(T ny = 0, T nv = 0) : y(ny), dy(nv){}
 };
 
+//segment of a string of size segments that a pick lands on, 0 if it misses the string
+inline size_t pickIndex(const Pick& pick, size_t size){
+    uint pickx = (uint)round(pick.pos.x*(float)(size-1));
+    return (pickx > 0 && pickx < size-1) ? pickx : 0;
+}
+
+//collision of one segment with a pick.
+//velocityUnit is the length of one time unit of dy in seconds, 1 unless velocities are stored per step
+template<typename T>
+void pickSegment(T& y, T& dy, const Pick& pick, float velocityUnit = 1.f){
+    if(abs(y-pick.pos.y)<=pick.radius){
+        if(abs(dy)>pick.radius*3*velocityUnit) dy=0;
+        dy *= T(0.5);
+        y = pick.pos.y+pick.radius*((pick.pos.y>y)? T(-0.99) : T(0.99));
+        //changing these out for -1 : 1 gets rid of fun energy preserving behaviour when holding the string at a point
+    }
+}
+
+//collision of one segment with a pick that moved from height enter to height exit while it was over the segment.
+//the segment ends up on the side of the pick it was on when the pick arrived, so a pick passing
+//through the string between two steps drags it along instead of skipping it.
+//with enter equal to exit it is pickSegment. returns whether the pick touched the segment
+template<typename T>
+bool sweptPickSegment(T& y, T& dy, float enter, float exit, float radius, float velocityUnit = 1.f){
+    if(y < T(std::min(enter, exit)-radius) || y > T(std::max(enter, exit)+radius)) return false;
+    if(abs(dy)>T(radius*3*velocityUnit)) dy=0;
+    dy *= T(0.5);
+    y = T(exit+radius*((T(enter)>y)? -0.99f : 0.99f));
+    return true;
+}
+
+//the straight path of a pick over one step, from where it was on the step before to where it is now,
+//measured in segments of a string of size segments. a pick that was not active on the step before
+//only covers where it is now. it passes over the moving segments [lo, hi], none if lo > hi
+struct PickSweep{
+    float x0, x1, y0, y1, radius;
+    size_t lo = 1, hi = 0;
+
+    PickSweep(const Pick& from, const Pick& to, size_t size)
+        :x0((from.active ? from.pos.x : to.pos.x)*float(size-1)), x1(to.pos.x*float(size-1)),
+        y0(from.active ? from.pos.y : to.pos.y), y1(to.pos.y), radius(to.radius)
+    {
+        if(!to.active) return;
+        long first = std::max(lround(std::min(x0, x1)), 1l);
+        long last = std::min(lround(std::max(x0, x1)), long(size)-2);
+        if(first > last) return;
+        lo = size_t(first);
+        hi = size_t(last);
+    }
+
+    bool empty() const {return lo > hi;}
+    //heights the pick sweeps, widened by its radius
+    float bottom() const {return std::min(y0, y1)-radius;}
+    float top() const {return std::max(y0, y1)+radius;}
+
+    //heights of the pick as it arrives over segment j and as it leaves it, or the step starts and ends
+    void heights(size_t j, float& enter, float& exit) const {
+        enter = y0;
+        exit = y1;
+        if(x1 == x0) return;
+        float ta = (float(j)-0.5f-x0)/(x1-x0);
+        float tb = (float(j)+0.5f-x0)/(x1-x0);
+        enter = y0+(y1-y0)*std::clamp(std::min(ta, tb), 0.f, 1.f);
+        exit = y0+(y1-y0)*std::clamp(std::max(ta, tb), 0.f, 1.f);
+    }
+};
+
+//a pick moving linearly over a block of steps, reaching to.pos on the last one.
+//it only touches the string if it is active at both ends of the block
+struct PickPath{
+    Pick pick;
+    vec2 start;
+    vec2 pickstep;
+
+    PickPath(const Pick& from, const Pick& to, size_t steps)
+        :pick(to), start(from.pos), pickstep((to.pos-from.pos)*(1.f/float(steps)))
+    {
+        pick.active = from.active && to.active;
+    }
+    //the pick during step (counted from 1) of the block
+    Pick at(size_t step) const {
+        Pick p = pick;
+        p.pos = start + pickstep*float(step);
+        return p;
+    }
+};
+
+//steps through a block of out.size()*substeps steps with the pick following path.
+//step(pick) takes one step with the pick where it is during that step and returns the tap,
+//and each sample of out keeps the tap of the last of its steps, as String::renderBlock does
+template<typename F>
+void renderWithPath(std::span<float> out, const PickPath& path, uint substeps, F&& step){
+    size_t s = 0;
+    for(float& samp : out){
+        for(uint k = 1; k<substeps; ++k) step(path.at(++s));
+        samp = float(step(path.at(++s)));
+    }
+}
+
+//a pick following a list of timed positions over a block of steps, such as the mouse events of a frame.
+//each key holds the pick at a time within the block, from 0 at its start to 1 at its last step, in order.
+//between two keys the pick moves linearly, and only touches the string if it is active at both.
+//before the first key and after the last one it stays where they are
+struct PickTrack{
+    struct Key{
+        float time;
+        Pick pick;
+    };
+    std::vector<Key> keys;
+
+    //whether the pick is active anywhere in the block
+    bool active() const {
+        for(size_t k = 1; k<keys.size(); ++k)
+            if(keys[k-1].pick.active && keys[k].pick.active) return true;
+        return keys.size() == 1 && keys[0].pick.active;
+    }
+
+    //the pick during step (counted from 1) of a block of steps
+    Pick at(size_t step, size_t steps) const {
+        if(keys.empty()) return {false, {0, 0}, 0};
+        float time = float(step)/float(steps);
+        auto next = std::upper_bound(keys.begin(), keys.end(), time, [](float t, const Key& k){return t < k.time;});
+        if(next == keys.begin()) return keys.front().pick;
+        if(next == keys.end()) return keys.back().pick;
+        const Key& before = *(next-1);
+        Pick p = next->pick;
+        float f = (time-before.time)/(next->time-before.time);
+        p.pos = before.pick.pos + (next->pick.pos-before.pick.pos)*f;
+        p.active = before.pick.active && next->pick.active;
+        return p;
+    }
+};
+
+//a function to generate a nice initial stroke shape,
+//giving segment i of sc from the offset of segment i-1
+template<typename T>
+T strokeShape(T previous, size_t i, uint sc){
+    return previous*0.90f + randomUnitFloat()*0.01f + 
+        (0.5f-abs(0.5f-pow(float(i)/float(sc), 2.f)))*0.4f*((float(sc-i)/float(sc)));
+}
+
+//layout policies for String<T, Layout>.
+//a layout owns the segment storage, gives access to single segments,
+//and runs the velocity and position loops over the half open range [lo, hi)
+
+//array of structures, each segment keeps its offset and velocity side by side.
+//this is the reference implementation
 template<typename T>
-struct String{
+struct SegmentVector{
+    static_assert(std::is_floating_point_v<T>, "fixed point strings step on SegmentArrays, see FixedString");
     std::vector<StringSegment<T>> string;
+    static constexpr bool tileable = false;
+    static constexpr size_t fixedSize = 0;
+
+    size_t size() const {return string.size();}
+    void resize(size_t n){string.resize(n);}
+    T& offset(size_t i){return string[i].y;}
+    T& velocity(size_t i){return string[i].dy;}
+    const T& offset(size_t i) const {return string[i].y;}
+    const T& velocity(size_t i) const {return string[i].dy;}
+
+    void strokeVelocities(const StringCoefficients<T>& c, size_t lo, size_t hi){
+        for(size_t i = lo; i<hi; ++i){
+            StringSegment<T>& me = string[i];
+            T dylw = me.y-string[i-1].y;
+            T dyhg = string[i+1].y-me.y;
+            T ddy = dylw-dyhg;
+            me.dy -= ddy*c.stiffness*c.step;
+            me.dy -= me.dy*c.air*c.step;
+            me.y -= ddy*c.step*c.friction;
+        }
+    }
+    void freeVelocities(const StringCoefficients<T>& c, size_t lo, size_t hi){
+        for(size_t i = lo; i<hi; ++i){
+            StringSegment<T>& me = string[i];
+            T dylw = me.y-string[i-1].y;
+            T dyhg = string[i+1].y-me.y;
+            T ddy = dylw-dyhg;
+            me.dy -= ddy*c.stiffness*c.step;
+        }
+    }
+    void integrate(const StringCoefficients<T>& c, size_t lo, size_t hi){
+        for(size_t i = lo; i<hi; ++i){
+            StringSegment<T>& me = string[i];
+            me.y += me.dy * c.step;
+        }
+    }
+};
+
+//structure of arrays, with offsets and velocities in separate cache line aligned arrays.
+//the loops read and write contiguous memory, and run on the simd kernels picked for this machine, see stringKernels.h
+template<typename T>
+struct SegmentArrays{
+    AlignedVector<T> y, dy;
+    //curvature scratch for strokeVelocities, shifted by two so the kernel may read two elements before lo
+    AlignedVector<T> curvature;
+    static constexpr size_t fixedSize = 0;
+
+    size_t size() const {return y.size();}
+    void resize(size_t n){
+        y.resize(n);
+        dy.resize(n);
+        curvature.resize(n+2);
+    }
+    T& offset(size_t i){return y[i];}
+    T& velocity(size_t i){return dy[i];}
+    const T& offset(size_t i) const {return y[i];}
+    const T& velocity(size_t i) const {return dy[i];}
+
+    void strokeVelocities(const StringCoefficients<T>& c, size_t lo, size_t hi){
+        const StringKernelTable<T>& k = stringKernels<T>();
+        T* J = curvature.data()+2;
+        k.curvature(y.data(), J, lo, hi);
+        J[lo-1] = 0;
+        J[lo-2] = 0;
+        k.strokeVelocities(y.data(), dy.data(), J, lo, hi, c);
+    }
+    void freeVelocities(const StringCoefficients<T>& c, size_t lo, size_t hi){
+        stringKernels<T>().freeVelocities(y.data(), dy.data(), lo, hi, c);
+    }
+    void integrate(const StringCoefficients<T>& c, size_t lo, size_t hi){
+        stringKernels<T>().integrate(y.data(), dy.data(), lo, hi, c);
+    }
+
+    //temporal blocking, which advances several strokes per tile of segments while the tile is in cache.
+    //step s of a tile covers the tile shifted s segments to the left, so every step only reads
+    //neighbours the step before it has finished. what a step needs from the part of the string
+    //left of its range, the old offset and the last two curvatures, is carried between tiles.
+    //afterVelocities(s, lo, hi) and afterPositions(s, lo, hi) run after each pass of step s over [lo, hi),
+    //which is where the String applies its pick and edge losses.
+    //the arithmetic is that of strokeVelocities followed by integrate, step by step
+    static constexpr bool tileable = true;
+    std::vector<T> tileCarry;
+
+    template<typename V, typename P>
+    void strokeTiled(const StringCoefficients<T>& c, uint steps, size_t width, V&& afterVelocities, P&& afterPositions){
+        const StringKernelTable<T>& k = stringKernels<T>();
+        size_t n = size();
+        T* J = curvature.data()+2;
+        width = std::max(width, size_t(steps)+1);
+        tileCarry.resize(steps*3);
+
+        for(size_t a = 1; a<n-1; a += width){
+            size_t b = std::min(a+width, n-1);
+            for(uint s = 0; s<steps; ++s){
+                T& yPrev = tileCarry[s*3];
+                T& J1 = tileCarry[s*3+1];
+                T& J2 = tileCarry[s*3+2];
+                if(a == 1){
+                    yPrev = y[0];
+                    J1 = 0;
+                    J2 = 0;
+                }
+                size_t lo = a == 1 ? 1 : a-s;
+                size_t hi = b == n-1 ? n-1 : b-s;
+                if(lo >= hi) continue;
+
+                T moved = y[lo-1];
+                y[lo-1] = yPrev;
+                k.curvature(y.data(), J, lo, hi);
+                y[lo-1] = moved;
+                J[lo-1] = J1;
+                J[lo-2] = J2;
+                yPrev = y[hi-1];
+                J1 = J[hi-1];
+                J2 = J[hi-2];
+
+                k.strokeVelocities(y.data(), dy.data(), J, lo, hi, c);
+                afterVelocities(s, lo, hi);
+                k.integrate(y.data(), dy.data(), lo, hi, c);
+                afterPositions(s, lo, hi);
+            }
+        }
+    }
+};
+
+//structure of arrays with the length N fixed at compile time, stored in place in cache line aligned arrays.
+//the loops run on rows of 8 segments (gcc/clang vector extensions, as in StringBank) plus a scalar remainder,
+//so the string is vectorized without relying on the autovectorizer, and with the boundaries known at compile time
+//the loops unroll without loads of the size. the arithmetic is that of the SegmentArrays kernels.
+//the string cannot be resized
+template<typename T, size_t N>
+struct StaticSegmentArrays{
+    static_assert(N >= 3, "a string needs at least one moving segment");
+    static_assert(std::is_floating_point_v<T>, "fixed point strings step on SegmentArrays, see FixedString");
+    static constexpr size_t Lanes = 8;
+    typedef ::Row<T, Lanes> Row;
+
+    alignas(64) std::array<T, N> y{};
+    alignas(64) std::array<T, N> dy{};
+    //curvature scratch, shifted by two as in SegmentArrays
+    alignas(64) std::array<T, N+2> curvature{};
+
+    static constexpr bool tileable = false;
+    static constexpr size_t fixedSize = N;
+
+    static constexpr size_t size() {return N;}
+    void resize(size_t){}
+    T& offset(size_t i){return y[i];}
+    T& velocity(size_t i){return dy[i];}
+    const T& offset(size_t i) const {return y[i];}
+    const T& velocity(size_t i) const {return dy[i];}
+
+
+    void strokeVelocities(const StringCoefficients<T>& c, size_t lo, size_t hi){
+        T* J = curvature.data()+2;
+        Row lw, me, hg, ddy, v, tail;
+        size_t i = lo;
+        for(; i+Lanes<=hi; i+=Lanes){
+            loadRow(lw, y.data()+i-1);
+            loadRow(me, y.data()+i);
+            loadRow(hg, y.data()+i+1);
+            storeRow(J+i, (me-lw)-(hg-me));
+        }
+        curvatureSoA(y.data(), J, i, hi);
+        J[lo-1] = 0;
+        J[lo-2] = 0;
+
+        const T kh = c.stiffnessStep;
+        const T ah = c.airStep;
+        const T fh = c.frictionStep;
+        for(i = lo; i+Lanes<=hi; i+=Lanes){
+            loadRow(tail, J+i-2);
+            loadRow(ddy, J+i-1);
+            tail = ddy + fh*tail;
+            loadRow(ddy, J+i);
+            ddy = ddy + fh*tail;
+            loadRow(v, dy.data()+i);
+            v = v - ddy*kh;
+            storeRow(dy.data()+i, v - v*ah);
+            loadRow(me, y.data()+i);
+            storeRow(y.data()+i, me - ddy*fh);
+        }
+        strokeVelocitiesSoA(y.data(), dy.data(), J, i, hi, c);
+    }
+    void freeVelocities(const StringCoefficients<T>& c, size_t lo, size_t hi){
+        const T kh = c.stiffnessStep;
+        Row lw, me, hg, v;
+        size_t i = lo;
+        for(; i+Lanes<=hi; i+=Lanes){
+            loadRow(lw, y.data()+i-1);
+            loadRow(me, y.data()+i);
+            loadRow(hg, y.data()+i+1);
+            loadRow(v, dy.data()+i);
+            storeRow(dy.data()+i, v - ((me-lw)-(hg-me))*kh);
+        }
+        freeVelocitiesSoA(y.data(), dy.data(), i, hi, c);
+    }
+    void integrate(const StringCoefficients<T>& c, size_t lo, size_t hi){
+        const T h = c.step;
+        Row me, v;
+        size_t i = lo;
+        for(; i+Lanes<=hi; i+=Lanes){
+            loadRow(me, y.data()+i);
+            loadRow(v, dy.data()+i);
+            storeRow(y.data()+i, me + v*h);
+        }
+        integrateSoA(y.data(), dy.data(), i, hi, c);
+    }
+};
+
+//step coefficients of a floating point string, grid or network with these parameters.
+//stiffness and elastic friction are divided by the square of segmentLength, see String::segmentLength,
+//and every rate is also folded with stepSize
+template<typename T>
+StringCoefficients<T> foldCoefficients(T stepSize, T segmentStiffness, T segmentLength, T airResistance, T elasticFriction){
+    T k = segmentStiffness/(segmentLength*segmentLength);
+    T f = elasticFriction/(segmentLength*segmentLength);
+    return {stepSize, k, airResistance, f, k*stepSize, airResistance*stepSize, f*stepSize};
+}
+
+//type of the physical parameters and the output of a String<T>.
+//a fixed point offset cannot hold a stiffness of 1.6e9, so those stay in double
+template<typename T>
+struct StringParameter{
+    typedef T type;
+};
+template<>
+struct StringParameter<q30>{
+    typedef double type;
+};
+
+template<typename T, typename Layout = SegmentVector<T>>
+struct String : Layout{
+    typedef typename StringParameter<T>::type Parameter;
+
     //T mass; //in kg
     //T tension; //in N
     //T length; //in m
@@ -44,91 +437,658 @@ struct String{
     //T edgeConductance;
 
 
-    T stepSize = 1.f/44100.f;
+    Parameter stepSize = 1.f/44100.f;
 
     //these variables were derived through trial and error
     //each assumes the length of a segment is 1, 
     //so they do not scale to give the same behaviour for different string sizes
 
-    T segmentStiffness = 1600000000.f; 
+    Parameter segmentStiffness = 1600000000.f; 
     //stiffness factor in wave equation
     //equal to the square of the speed of sound.
 
-    T edgeResistance = 400.f; 
+    Parameter edgeResistance = 400.f; 
     //degree to which the edges are pulled toward zero. Simulates losses to the instrument body
     
-    T airResistance = 0.2f; 
+    Parameter airResistance = 0.2f; 
     //amount of air resistance proportional to velocity. 
 
-    T elasticFriction = 0.02f; 
+    Parameter elasticFriction = 0.02f; 
     //simulates the heat equation alongside the wave equation
     //to emulate loss of high-frequency oscilations to elastic friction.
     //essentially, the curve of a segment, besides contributing to its acceleration
     //also causes an inwards offsett proportional to elasticFriction.
     //this deletes energy, and should  disproportionally effect high frequencies
 
+    Parameter segmentLength = 1.f;
+    //length of a segment in the units of the parameters above.
+    //the curvature of a segment is divided by its square, so segmentStiffness and elasticFriction
+    //keep their meaning when a string is cut into more or fewer segments
+
+    //layouts with a length fixed at compile time keep it, the others start at 300 segments
     String(){
-        uint sc = 300;
-        string.resize(sc);
-        string[0] = 0;
-        string[sc-1] = 0;
-        for(size_t i = 1; i<sc-1; ++i){ //a function to generate a nice initial stroke shape
-            string[i] = StringSegment<T>(string[i-1].y*0.90f + randomUnitFloat()*0.01f + 
-                (0.5f-abs(0.5f-pow(float(i)/float(sc), 2.f)))*0.4f*((float(sc-i)/float(sc))), 0);
+        uint sc = Layout::fixedSize ? uint(Layout::fixedSize) : 300;
+        this->resize(sc);
+        this->offset(0) = 0;
+        this->offset(sc-1) = 0;
+        for(size_t i = 1; i<sc-1; ++i){
+            this->offset(i) = strokeShape(this->offset(i-1), i, sc);
+            this->velocity(i) = 0;
         }
     }
 
-    T stepNoFriction(){
-        //update velocities from curvatures
-        for(size_t i = 1; i<string.size()-1; ++i){
-            StringSegment<T>& me = string[i];
-            T dylw = me.y-string[i-1].y;
-            T dyhg = string[i+1].y-me.y;
-            T ddy = dylw-dyhg;
-            me.dy -= ddy*segmentStiffness*stepSize;
+    //fixed point strings keep velocities in offset per step instead of offset per second,
+    //as a velocity of a few hundred per second does not fit in q30.
+    //the step then becomes 1, and the stiffness picks up a second factor of stepSize
+    StringCoefficients<T> coefficients() const {
+        if constexpr(std::is_floating_point_v<T>){
+            return foldCoefficients<T>(stepSize, segmentStiffness, segmentLength, airResistance, elasticFriction);
         }
-        //update positions based on velocities
-        for(size_t i = 1; i<string.size()-1; ++i){
-            StringSegment<T>& me = string[i];
-            me.y += me.dy * stepSize;
+        else{
+            Parameter k = curvatureStiffness(), f = curvatureFriction();
+            return {T(1.), T(0.), T(0.), T(0.),
+                T(k*stepSize*stepSize), T(airResistance*stepSize), T(f*stepSize)};
         }
+    }
 
-        return (string[1].y-string[string.size()-2].y)*10;
+    //segmentStiffness and elasticFriction per unit of curvature, see segmentLength
+    Parameter curvatureStiffness() const {
+        return segmentStiffness/(segmentLength*segmentLength);
+    }
+    Parameter curvatureFriction() const {
+        return elasticFriction/(segmentLength*segmentLength);
     }
 
+    //fewest steps that split a sample of sampleTime seconds without the explicit step blowing up.
+    //a step of length h is stable while the wave crosses less than a segment per step,
+    //sqrt(curvatureStiffness())*h < 1, and the elastic friction smooths less than its own curvature,
+    //curvatureFriction()*h < 1/2. courant is the share of those limits a step may use,
+    //kept below 1 as the step is only marginally stable at the limit itself.
+    //the implicit step is stable at any length, so it takes one step per sample
+    uint stableSubsteps(Parameter sampleTime, Parameter courant = 0.95f) const {
+        if(implicit) return 1;
+        Parameter wave = sqrt(curvatureStiffness())*sampleTime;
+        Parameter smoothing = 2*curvatureFriction()*sampleTime;
+        return std::max(1u, uint(ceil(std::max(wave, smoothing)/courant)));
+    }
 
-    T stepStroked(const Pick& pick){
+    //time unit of the stored velocities, see coefficients()
+    float velocityUnit() const {
+        return std::is_floating_point_v<T> ? 1.f : float(stepSize);
+    }
 
-        for(size_t i = 1; i<string.size()-1; ++i){
-            StringSegment<T>& me = string[i];
-            T dylw = me.y-string[i-1].y;
-            T dyhg = string[i+1].y-me.y;
-            T ddy = dylw-dyhg;
-            me.dy -= ddy*segmentStiffness*stepSize;
-            me.dy -= me.dy*airResistance*stepSize;
-            me.y -= ddy*stepSize*elasticFriction;
+    Parameter output() const {
+        return (this->offset(1)-this->offset(this->size()-2))*10;
+    }
+
+    Parameter stepNoFriction(){
+        StringCoefficients<T> c = coefficients();
+        widenActive(1, 1);
+        if(activeLo < activeHi){
+            //update velocities from curvatures
+            this->freeVelocities(c, activeLo, activeHi);
+            //update positions based on velocities
+            this->integrate(c, activeLo, activeHi);
         }
 
+        return output();
+    }
+
 
-        if(pick.active){
-            uint pickx = (uint)round(pick.pos.x*(float)(string.size()-1));
+    Parameter stepStroked(const Pick& pick){
+        return stepStroked(pick, coefficients());
+    }
+
+    Parameter stepStroked(const Pick& pick, const StringCoefficients<T>& c){
+        return stepStroked(std::span<const Pick>(&pick, 1), c);
+    }
 
-            if(pickx > 0 && pickx < string.size()-1) 
-            if(abs(string[pickx].y-pick.pos.y)<=pick.radius){
-                if(abs(string[pickx].dy)>pick.radius*3) string[pickx].dy=0;
-                string[pickx].dy *= 0.5;
-                string[pickx].y = pick.pos.y+pick.radius*((pick.pos.y>string[pickx].y)? -0.99 : 0.99);
-                //changing these out for -1 : 1 gets rid of fun energy preserving behaviour when holding the string at a point
+    //steps the string against several picks at once, such as one per finger.
+    //pick k sweeps from where picks[k] was on the last step, see contact()
+    Parameter stepStroked(std::span<const Pick> picks){
+        return stepStroked(picks, coefficients());
+    }
+
+    Parameter stepStroked(std::span<const Pick> picks, const StringCoefficients<T>& c){
+        if(asleep){
+            if(!wakes(picks)){
+                lastPicks.assign(picks.begin(), picks.end());
+                return 0;
             }
+            asleep = false;
         }
+        Parameter tap;
+        if constexpr(std::is_floating_point_v<T>) tap = implicit ? stepImplicit(picks) : stepExplicit(picks, c);
+        else tap = stepExplicit(picks, c);
+        countSteps(1, std::any_of(picks.begin(), picks.end(), [](const Pick& p){return p.active;}));
+        return tap;
+    }
 
+    Parameter stepExplicit(std::span<const Pick> picks, const StringCoefficients<T>& c){
+        size_t sz = this->size();
 
-        for(size_t i = 1; i<string.size()-1; ++i){
-            StringSegment<T>& me = string[i];
-            me.y += me.dy * stepSize;
+        widenActive(1, 3);
+        if(activeLo < activeHi) this->strokeVelocities(c, activeLo, activeHi);
+
+
+        contact(picks);
+
+
+        if(activeLo < activeHi) this->integrate(c, activeLo, activeHi);
+        dampEdge(1);
+        dampEdge(sz-2);
+        return output();
+    }
+
+    size_t pickIndex(const Pick& pick) const {
+        return ::pickIndex(pick, this->size());
+    }
+
+    //energy of the string, with segments of unit mass:
+    //kinetic from the velocities, potential from the stretch between neighbours
+    Parameter energy() const {
+        Parameter perSecond = 1/Parameter(velocityUnit());
+        Parameter kinetic = 0, potential = 0;
+        for(size_t i = 1; i<this->size()-1; ++i){
+            Parameter v = Parameter(this->velocity(i))*perSecond;
+            kinetic += v*v;
         }
-        string[1].y                 -= string[1].y*edgeResistance*stepSize;
-        string[string.size()-2].y   -= string[string.size()-2].y*edgeResistance*stepSize;
-        return (string[1].y-string[string.size()-2].y)*10;
+        for(size_t i = 1; i<this->size(); ++i){
+            Parameter d = Parameter(this->offset(i))-Parameter(this->offset(i-1));
+            potential += d*d;
+        }
+        return (kinetic + curvatureStiffness()*potential)/2;
+    }
+
+    //a string whose energy() falls below sleepEnergy*curvatureStiffness() with no pick on it
+    //is put to rest and no longer stepped. it outputs silence until a pick touches it again.
+    //sleepEnergy is in squared offset, so it holds for any tuning: 1e-8 is the energy of a string
+    //stretched about 1e-4 out of line. the energy is checked every sleepInterval steps,
+    //so tracking it costs a small fraction of a step. a sleepEnergy of 0 keeps the string awake.
+    //call wake() after writing to a sleeping string
+    Parameter sleepEnergy = 1e-8f;
+    uint sleepInterval = 1024;
+    bool asleep = false;
+
+    //wakes the string with all of it active, for after writing offsets or velocities from outside
+    void wake(){
+        asleep = false;
+        activeLo = 1;
+        activeHi = SIZE_MAX;
     }
-};
\ No newline at end of file
+
+    //whether every moving segment is stepped, see activeLo
+    bool fullyActive() const {
+        return activeLo <= 1 && activeHi >= this->size()-1;
+    }
+
+    //losses to the instrument body, pulling an outermost moving segment toward zero
+    void dampEdge(size_t i){
+        this->offset(i) -= this->offset(i)*edgeResistance*stepSize;
+    }
+
+    //steps with the implicit Crank-Nicolson scheme instead of the explicit one.
+    //the explicit step blows up once segmentStiffness*stepSize^2 passes 1, so stiff strings need substeps,
+    //while the implicit step stays stable for any stiffness and stepSize, at the cost of a tridiagonal solve.
+    //high partials come out flatter the further stepSize is past that limit. floating point strings only
+    bool implicit = false;
+
+    //one Crank-Nicolson step of
+    //    y' = v - elasticFriction*L(y)
+    //    v' = -segmentStiffness*L(y) - airResistance*v
+    //with L the curvature. eliminating the new velocity leaves (I + c*L)y1 = y0 + h/a*v0 - c*L(y0)
+    //with a = 1 + airResistance*h/2 and c = elasticFriction*h/2 + segmentStiffness*h^2/(4a),
+    //after which the new velocity follows from the second equation.
+    //the pick and the edge losses are applied after the step
+    Parameter stepImplicit(std::span<const Pick> picks){
+        size_t sz = this->size();
+        T h = stepSize;
+        T f = curvatureFriction();
+        T a = 1 + airResistance*h/2;
+        T cc = f*h/2 + curvatureStiffness()*h*h/(4*a);
+        //the solve couples every segment to every other one
+        activeLo = 1;
+        activeHi = SIZE_MAX;
+        implicitSolver.factor(cc, sz-2);
+
+        implicitY.resize(sz);
+        implicitX.resize(sz);
+        T* y = implicitY.data();
+        T* x = implicitX.data();
+        for(size_t i = 0; i<sz; ++i) y[i] = this->offset(i);
+        x[0] = y[0];
+        x[sz-1] = y[sz-1];
+        for(size_t i = 1; i<sz-1; ++i)
+            x[i] = y[i] + this->velocity(i)*(h/a) - cc*((y[i]-y[i-1])-(y[i+1]-y[i]));
+        x[1] += cc*y[0];
+        x[sz-2] += cc*y[sz-1];
+        implicitSolver.solve(x+1);
+
+        for(size_t i = 1; i<sz-1; ++i){
+            T curve = ((y[i]+x[i])-(y[i-1]+x[i-1]))-((y[i+1]+x[i+1])-(y[i]+x[i]));
+            this->velocity(i) = (x[i]-y[i])*(2/h) - this->velocity(i) + curve*f;
+            this->offset(i) = x[i];
+        }
+
+        contact(picks);
+        dampEdge(1);
+        dampEdge(sz-2);
+        return output();
+    }
+
+    //temporal blocking for long strings, on layouts that support it (SegmentArrays).
+    //renderBlock then advances tileSteps steps per tile of tileWidth segments,
+    //so a tile is streamed from memory once per tileSteps steps instead of twice every step.
+    //1 steps the whole string once per step
+    uint tileSteps = 1;
+    size_t tileWidth = 2048;
+
+    //scratch for tiled rendering
+    std::vector<Pick> tilePicks;
+    std::vector<T> tileTapLo, tileTapHi;
+
+    //factorization and scratch for the implicit step
+    ThomasSolver<Parameter> implicitSolver;
+    AlignedVector<T> implicitY, implicitX;
+
+    //contacts with picks, swept over each step. a pick that moves along the string between two steps
+    //touches every segment it passes, so a fast pick cannot skip over the string.
+    //picks are tested against the lowest and highest offset of every contactBlock segments,
+    //summarized once per step for the blocks some pick passes, so a pick only tests segments it can reach
+    //and each more pick costs little more than the blocks it sweeps
+    static constexpr size_t contactBlock = 64;
+
+    //picks of the last step, where the picks of the next one sweep from
+    std::vector<Pick> lastPicks;
+
+    //steps the string through a whole block of samples, writing one output tap per sample into out.
+    //the pick follows a PickPath from from to to.
+    //each sample is substeps steps long, and keeps the tap of the last one
+    void renderBlock(std::span<float> out, const Pick& from, const Pick& to, uint substeps = 1){
+        PickPath path(from, to, out.size()*substeps);
+        //a pick inactive at either end of the block never touches the string
+        renderPick(out, substeps, path.pick.active, [&](size_t step){return path.at(step);});
+    }
+
+    //renderBlock with the pick following a PickTrack, so it keeps the timing of the input within the block
+    void renderBlock(std::span<float> out, const PickTrack& track, uint substeps = 1){
+        size_t steps = out.size()*substeps;
+        renderPick(out, substeps, track.active(), [&](size_t step){return track.at(step, steps);});
+    }
+
+    //renderBlock for several picks, pick k following a PickPath from from[k] to to[k]
+    void renderBlock(std::span<float> out, std::span<const Pick> from, std::span<const Pick> to, uint substeps = 1){
+        StringCoefficients<T> c = coefficients();
+        size_t steps = out.size()*substeps;
+        blockPaths.clear();
+        for(size_t k = 0; k<std::min(from.size(), to.size()); ++k)
+            blockPaths.emplace_back(from[k], to[k], steps);
+
+        if(asleep && std::none_of(blockPaths.begin(), blockPaths.end(), [](const PickPath& p){return p.pick.active;})){
+            std::fill(out.begin(), out.end(), 0.f);
+            lastPicks.clear();
+            return;
+        }
+
+        blockPicks.resize(blockPaths.size());
+        size_t step = 0;
+        for(float& samp : out){
+            Parameter tap = 0;
+            for(uint s = 0; s<substeps; ++s){
+                ++step;
+                for(size_t k = 0; k<blockPaths.size(); ++k) blockPicks[k] = blockPaths[k].at(step);
+                tap = stepStroked(blockPicks, c);
+            }
+            samp = float(tap);
+        }
+    }
+
+    //least steps per sample renderStable takes, even when fewer would be stable
+    uint oversampling = 1;
+
+    //renders a block of samples at sampleRate, splitting each sample into stableSubsteps() steps,
+    //or oversampling steps if that is more.
+    //stepSize is set to the length of those steps, so it follows the parameters as they are retuned,
+    //and the string spends no more steps than it needs to stay stable.
+    //the taps of all steps are filtered down to sampleRate by a polyphase decimator, rather than keeping
+    //the last tap of each sample, which would fold everything above half the sample rate back into it.
+    //the taps are rendered a buffer of stableChunk steps at a time, so nothing is allocated per block.
+    //returns the number of steps per sample, the step rate is that times sampleRate
+    uint renderStable(std::span<float> out, const Pick& from, const Pick& to, Parameter sampleRate){
+        uint substeps = stableStep(sampleRate);
+        PickPath path(from, to, out.size()*substeps);
+        renderDecimated(out, substeps, path.pick.active, [&](size_t step){return path.at(step);});
+        return substeps;
+    }
+    uint renderStable(std::span<float> out, const PickTrack& track, Parameter sampleRate){
+        uint substeps = stableStep(sampleRate);
+        size_t steps = out.size()*substeps;
+        renderDecimated(out, substeps, track.active(), [&](size_t step){return track.at(step, steps);});
+        return substeps;
+    }
+
+private:
+    size_t stepsSinceCheck = 0;
+
+    //taps at the step rate and the filter taking them to the sample rate, for renderStable
+    static constexpr size_t stableChunk = 4096;
+    std::vector<float> oversampled = std::vector<float>(stableChunk);
+    PolyphaseDecimator decimator = PolyphaseDecimator(1, 32, 16, stableChunk);
+
+    uint stableStep(Parameter sampleRate){
+        Parameter sampleTime = 1/sampleRate;
+        uint substeps = std::max(stableSubsteps(sampleTime), oversampling);
+        stepSize = sampleTime/Parameter(substeps);
+        return substeps;
+    }
+    //renders out in pieces of whole samples that fit in oversampled, and decimates each piece.
+    //the decimator changes factor in place, keeping its inputs, so a retune does not click
+    template<typename F>
+    void renderDecimated(std::span<float> out, uint substeps, bool touching, F&& pickAt){
+        decimator.setFactor(substeps);
+        if(oversampled.size() < substeps) oversampled.resize(substeps);
+        size_t chunk = oversampled.size()/substeps;
+        for(size_t first = 0; first<out.size(); first += chunk){
+            size_t n = std::min(chunk, out.size()-first);
+            std::span<float> taps(oversampled.data(), n*substeps);
+            size_t offset = first*substeps;
+            renderPick(taps, 1, touching, [&](size_t step){return pickAt(offset+step);});
+            decimator.process(taps, out.subspan(first, n));
+        }
+    }
+
+    //segments [activeLo, activeHi) that may be away from rest, the only ones the explicit steps cover.
+    //every other segment and its velocity is exactly zero, so a string woken by a pick on a long string
+    //is only stepped where the disturbance has spread to. a step carries it one segment to the left,
+    //and to the right one for the curvature plus two for the elastic friction recurrence of the kernels.
+    //the SegmentVector loop carries friction further right, by a factor of elasticFriction*stepSize
+    //per segment, which the region drops past those three.
+    //activeHi may run past the string, which is then active to its end. the region is empty once asleep
+    size_t activeLo = 1;
+    size_t activeHi = SIZE_MAX;
+
+    //grows the active region by what one step can reach, clamped to the moving segments
+    void widenActive(size_t left, size_t right){
+        size_t sz = this->size();
+        if(activeLo >= activeHi) return;
+        activeLo = activeLo > left+1 ? activeLo-left : 1;
+        activeHi = std::min(activeHi, sz-1-right) + right;
+    }
+    void includeActive(size_t i){
+        if(activeLo >= activeHi){
+            activeLo = i;
+            activeHi = i+1;
+        }
+        activeLo = std::min(activeLo, i);
+        activeHi = std::max(activeHi, i+1);
+    }
+
+    //scratch for rendering several picks
+    std::vector<PickPath> blockPaths;
+    std::vector<Pick> blockPicks;
+
+    //lowest and highest offset of each block of contactBlock segments,
+    //valid for the blocks whose stamp is contactStep
+    std::vector<T> blockLowest, blockHighest;
+    std::vector<uint64_t> blockStamp;
+    uint64_t contactStep = 0;
+
+    const Pick& lastPick(size_t k) const {
+        static const Pick none = {false, {0, 0}, 0};
+        return k < lastPicks.size() ? lastPicks[k] : none;
+    }
+
+    //whether a pick sweeps through the string at rest, the only state it sleeps in
+    bool wakes(std::span<const Pick> picks) const {
+        for(size_t k = 0; k<picks.size(); ++k){
+            PickSweep sweep(lastPick(k), picks[k], this->size());
+            if(!sweep.empty() && sweep.bottom() <= 0 && sweep.top() >= 0) return true;
+        }
+        return false;
+    }
+
+    void summarize(size_t b){
+        if(blockStamp[b] == contactStep) return;
+        blockStamp[b] = contactStep;
+        size_t lo = b*contactBlock, hi = std::min(lo+contactBlock, this->size());
+        T lowest = this->offset(lo), highest = lowest;
+        for(size_t i = lo+1; i<hi; ++i){
+            lowest = std::min(lowest, this->offset(i));
+            highest = std::max(highest, this->offset(i));
+        }
+        blockLowest[b] = lowest;
+        blockHighest[b] = highest;
+    }
+
+    //moves every segment a pick swept through during this step to its side of the pick.
+    //the sweeps are tested in order, so where picks overlap the last one wins
+    void contact(std::span<const Pick> picks){
+        size_t sz = this->size();
+        size_t blocks = (sz+contactBlock-1)/contactBlock;
+        if(blockStamp.size() != blocks){
+            blockStamp.assign(blocks, 0);
+            blockLowest.resize(blocks);
+            blockHighest.resize(blocks);
+        }
+        ++contactStep;
+
+        for(size_t k = 0; k<picks.size(); ++k){
+            PickSweep sweep(lastPick(k), picks[k], sz);
+            if(sweep.empty()) continue;
+            T bottom = T(sweep.bottom()), top = T(sweep.top());
+            for(size_t b = sweep.lo/contactBlock; b<=sweep.hi/contactBlock; ++b){
+                summarize(b);
+                if(blockHighest[b] < bottom || blockLowest[b] > top) continue;
+                size_t lo = std::max(sweep.lo, b*contactBlock);
+                size_t hi = std::min(sweep.hi+1, (b+1)*contactBlock);
+                for(size_t j = lo; j<hi; ++j){
+                    float enter, exit;
+                    sweep.heights(j, enter, exit);
+                    if(!sweptPickSegment(this->offset(j), this->velocity(j), enter, exit, sweep.radius, velocityUnit())) continue;
+                    includeActive(j);
+                    blockLowest[b] = std::min(blockLowest[b], this->offset(j));
+                    blockHighest[b] = std::max(blockHighest[b], this->offset(j));
+                }
+            }
+        }
+        lastPicks.assign(picks.begin(), picks.end());
+    }
+
+    //checks the energy once sleepInterval steps have passed, and puts the string to rest if it ran out
+    void countSteps(size_t steps, bool picked){
+        stepsSinceCheck += steps;
+        if(stepsSinceCheck < sleepInterval) return;
+        stepsSinceCheck = 0;
+        if(picked || energy() >= sleepEnergy*curvatureStiffness()) return;
+        for(size_t i = 0; i<this->size(); ++i){
+            this->offset(i) = 0;
+            this->velocity(i) = 0;
+        }
+        asleep = true;
+        activeLo = 0;
+        activeHi = 0;
+    }
+
+    //renderBlock for a single pick, which is pickAt(step) during each step of the block.
+    //touching tells whether it is active anywhere in the block
+    template<typename F>
+    void renderPick(std::span<float> out, uint substeps, bool touching, F&& pickAt){
+        StringCoefficients<T> c = coefficients();
+        size_t steps = out.size()*substeps;
+
+        if(asleep && !touching){
+            std::fill(out.begin(), out.end(), 0.f);
+            lastPicks.clear();
+            return;
+        }
+
+        if constexpr(Layout::tileable){
+            if(tileSteps > 1 && !implicit && fullyActive()){
+                renderTiled(out, substeps, c, pickAt);
+                lastPicks.assign(1, pickAt(steps));
+                countSteps(steps, touching);
+                return;
+            }
+        }
+
+        size_t step = 0;
+        for(float& samp : out){
+            Parameter tap = 0;
+            for(uint s = 0; s<substeps; ++s)
+                tap = stepStroked(pickAt(++step), c);
+            samp = float(tap);
+        }
+    }
+
+    template<typename F>
+    void renderTiled(std::span<float> out, uint substeps, const StringCoefficients<T>& c, F&& pickAt){
+        size_t sz = this->size();
+        size_t steps = out.size()*substeps;
+        for(size_t done = 0; done<steps;){
+            uint group = uint(std::min(size_t(tileSteps), steps-done));
+            //tilePicks[s] is the pick before step s of the group, tilePicks[s+1] the one during it
+            tilePicks.resize(group+1);
+            tileTapLo.resize(group);
+            tileTapHi.resize(group);
+            tilePicks[0] = done ? pickAt(done) : lastPick(0);
+            for(uint s = 0; s<group; ++s)
+                tilePicks[s+1] = pickAt(done+s+1);
+
+            this->strokeTiled(c, group, tileWidth,
+                [&](uint s, size_t lo, size_t hi){
+                    PickSweep sweep(tilePicks[s], tilePicks[s+1], sz);
+                    for(size_t j = std::max(sweep.lo, lo); j<std::min(sweep.hi+1, hi); ++j){
+                        float enter, exit;
+                        sweep.heights(j, enter, exit);
+                        sweptPickSegment(this->offset(j), this->velocity(j), enter, exit, sweep.radius, velocityUnit());
+                    }
+                },
+                [&](uint s, size_t lo, size_t hi){
+                    if(lo <= 1 && 1 < hi){
+                        dampEdge(1);
+                        tileTapLo[s] = this->offset(1);
+                    }
+                    if(lo <= sz-2 && sz-2 < hi){
+                        dampEdge(sz-2);
+                        tileTapHi[s] = this->offset(sz-2);
+                    }
+                });
+
+            for(uint s = 0; s<group; ++s){
+                size_t step = done+s+1;
+                if(step%substeps == 0) out[step/substeps-1] = float((tileTapLo[s]-tileTapHi[s])*10);
+            }
+            done += group;
+        }
+    }
+};
+
+//Lanes independent strings of equal length, stepped together in one pass.
+//segments are interleaved with the string index innermost, so y[i*Lanes+l] is segment i of string l,
+//and each segment row of all voices is one vector (a gcc/clang vector extension, split by the compiler
+//into whatever registers the target has).
+//the elastic friction recurrence of the reference loop runs along the segments,
+//so it is kept exactly here, and each voice follows the same arithmetic as String<T>.
+//each string has its own parameters, so voices are tuned through segmentStiffness
+template<typename T, size_t Lanes>
+struct StringBank{
+    static_assert((Lanes & (Lanes-1)) == 0, "StringBank needs a power of two number of lanes");
+    typedef ::Row<T, Lanes> Row;
+
+    AlignedVector<T> y, dy;
+
+    T stepSize = 1.f/44100.f;
+
+    //per voice counterparts of the String parameters
+    std::array<T, Lanes> segmentStiffness;
+    std::array<T, Lanes> edgeResistance;
+    std::array<T, Lanes> airResistance;
+    std::array<T, Lanes> elasticFriction;
+
+    //output taps of the last step, one per voice
+    std::array<T, Lanes> taps{};
+
+    StringBank(uint sc = 300)
+        :y(sc*Lanes, 0), dy(sc*Lanes, 0)
+    {
+        segmentStiffness.fill(1600000000.f);
+        edgeResistance.fill(400.f);
+        airResistance.fill(0.2f);
+        elasticFriction.fill(0.02f);
+        for(size_t l = 0; l<Lanes; ++l)
+            for(size_t i = 1; i<sc-1; ++i)
+                y[i*Lanes+l] = strokeShape(y[(i-1)*Lanes+l], i, sc);
+    }
+
+    size_t size() const {return y.size()/Lanes;}
+
+
+    //steps every string once, each against its own pick, and returns the mix of all voices
+    T stepStroked(const std::array<Pick, Lanes>& picks){
+        size_t sz = size();
+        Row k, a, f, e;
+        loadRow(k, segmentStiffness.data());
+        loadRow(a, airResistance.data());
+        loadRow(f, elasticFriction.data());
+        loadRow(e, edgeResistance.data());
+        const T h = stepSize;
+
+        //the row below is carried in a register, already moved by elastic friction as in the reference loop
+        Row lw, me, hg, v;
+        loadRow(lw, y.data());
+        loadRow(me, y.data()+Lanes);
+        for(size_t i = 1; i<sz-1; ++i){
+            loadRow(hg, y.data()+(i+1)*Lanes);
+            Row dylw = me-lw;
+            Row dyhg = hg-me;
+            Row ddy = dylw-dyhg;
+            loadRow(v, dy.data()+i*Lanes);
+            v -= ddy*k*h;
+            v -= v*a*h;
+            me -= ddy*h*f;
+            storeRow(dy.data()+i*Lanes, v);
+            storeRow(y.data()+i*Lanes, me);
+            lw = me;
+            me = hg;
+        }
+
+        for(size_t l = 0; l<Lanes; ++l){
+            if(!picks[l].active) continue;
+            size_t pickx = pickIndex(picks[l], sz);
+            if(pickx) pickSegment(y[pickx*Lanes+l], dy[pickx*Lanes+l], picks[l]);
+        }
+
+        Row row, vel;
+        for(size_t i = 1; i<sz-1; ++i){
+            loadRow(row, y.data()+i*Lanes);
+            loadRow(vel, dy.data()+i*Lanes);
+            row += vel * h;
+            storeRow(y.data()+i*Lanes, row);
+        }
+
+        Row first, last;
+        loadRow(first, y.data()+Lanes);
+        loadRow(last, y.data()+(sz-2)*Lanes);
+        first -= first*e*h;
+        last -= last*e*h;
+        storeRow(y.data()+Lanes, first);
+        storeRow(y.data()+(sz-2)*Lanes, last);
+        storeRow(taps.data(), (first-last)*10);
+
+        T mix = 0;
+        for(T tap : taps) mix += tap;
+        return mix;
+    }
+
+    //offset of segment i of voice l, for drawing
+    T offset(size_t l, size_t i) const {return y[i*Lanes+l];}
+};
+
+//string of N segments with its length known at compile time, see StaticSegmentArrays.
+//String<T> stays the one to use when the length is only known at runtime
+template<typename T, size_t N>
+using StaticString = String<T, StaticSegmentArrays<T, N>>;
+
+//deterministic string in Q1.30 fixed point, see myfixed.h.
+//its kernels only use integer arithmetic, so it steps to the same bits on every machine and simd tier
+typedef String<q30, SegmentArrays<q30>> FixedString;
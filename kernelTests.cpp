@@ -0,0 +1,25 @@
+#include "stringKernels.h"
+
+//checks every vectorized kernel tier this cpu supports against the scalar kernels,
+//within a tolerance for floating point strings and bit for bit for fixed point ones.
+//names the tiers it could not check. run by meson test
+int main(){
+    for(SimdLevel level : {SimdLevel::sse, SimdLevel::avx2, SimdLevel::avx512}){
+        std::cout << simdLevelName(level) << (simdLevelSupported(level) ? ": checked\n" : ": skipped, not supported by this cpu\n");
+    }
+
+    bool agree = true;
+    if(!stringKernelsAgree<float>()){
+        std::cout << "float string kernels disagree\n";
+        agree = false;
+    }
+    if(!stringKernelsAgree<double>()){
+        std::cout << "double string kernels disagree\n";
+        agree = false;
+    }
+    if(!fixedKernelsAgree()){
+        std::cout << "fixed point string kernels disagree\n";
+        agree = false;
+    }
+    return agree ? 0 : 1;
+}
@@ -1,6 +1,7 @@
 #include "DrawableEnvironment.h"
 #include "myAudioUtilities.h"
 #include "generators.h"
+#include "BodyResonator.h"
 
 
 #include "std_lib_facilities.h"
@@ -11,18 +12,115 @@ float fetchY(const StringSegment<float>& seg){
     return seg.y;
 }
 
+//a pick posted by the ui thread to the audio thread, at the time of its mouse event in milliseconds
+struct PostedPick{
+    uint32_t time;
+    Pick pick;
+};
+
 int main() {
     DrawableEnvironment env;
-    AudioStream austr(44100, 4000);
+    //the audio thread owns the string and renders exactly the samples the device asks for,
+    //following the picks the ui thread posts. set it to false to render blocks on the ui thread instead,
+    //sized from the frame time and queued ahead of the device
+    const bool pullAudio = true;
+    //samples per device block. pulling, this is what the device buffers add to the latency,
+    //pushing, the queue runs ahead of the device anyway
+    const uint deviceBlock = pullAudio ? 512 : 4000;
+
+    //the strings sound through the body of the instrument, which lags by the largest block it is given:
+    //a device block when pulling, up to the 10000 samples queued per frame when pushing
+    BodyResonator body(bodyResponse(44100.f), 256, pullAudio ? deviceBlock : 10000);
 
     String<float> stringsim;
-    //change the stepSize to make the simulation faster/slower
-    //stringsim.stepSize /= 512.f;
+    //simulated seconds per second of audio, lower it to make the simulation slower.
+    //the string picks its own stepSize and substeps from it, see String::renderStable
+    float timeScale = 1.f;
+    //timeScale /= 512.f;
+    //the implicit step stays stable for any stepSize and stiffness, so it never needs substeps
+    //stringsim.implicit = true;
+    //steps per sample even when fewer would be stable, the taps are decimated to the sample rate
+    stringsim.oversampling = 2;
+    uint substeps = 0;
 
     grapher gra(150, -1, 1, {{-70, -70},{70, 70}});
     env.bind(gra);
 
     Pick lastpick = {0,0,0}; //used to interpolate between pick positions
+    PickTrack track;
+    std::vector<float> block;
+
+    SpscRing<PostedPick> posted(4096);
+    //picks popped from posted whose sample has not been rendered yet, oldest first
+    std::vector<PostedPick> arrived(posted.capacity());
+    size_t waiting = 0;
+    PickTrack pulledTrack;
+    pulledTrack.keys.reserve(arrived.size()+2);
+    Pick pulledLast = {0,0,0};
+    std::atomic<uint> pulledSubsteps{0};
+    //samples rendered so far, and the SDL_GetTicks() time of the first one, taken once so the audio clock
+    //runs at the sample rate from there on
+    uint64_t audioClock = 0;
+    uint32_t audioStartMs = 0;
+    //the longest recent ui frame in samples, measured by the ui thread. the ui posts the events of a frame
+    //after it, so a pick sounds this much plus a device block after its mouse event: the render runs that
+    //far ahead of the ticks, and the events keep their spacing
+    std::atomic<uint> frameSamples{0};
+    //copy of the string for the graph, taken only when the ui is not reading it, so audio never waits
+    std::mutex shownLock;
+    auto shown = stringsim.string;
+
+    //runs on the audio thread. each posted pick is placed at the sample of its mouse event on the audio clock,
+    //pickDelay later, and picks that belong to a later block wait for it
+    auto render = [&](std::span<float> out){
+        if(audioClock == 0) audioStartMs = SDL_GetTicks();
+        double blockStartMs = double(audioStartMs) + double(audioClock)*1000/44100;
+        double pickDelay = double(frameSamples.load(std::memory_order_relaxed) + out.size());
+        waiting += posted.pop(std::span<PostedPick>(arrived.data()+waiting, arrived.size()-waiting));
+
+        pulledTrack.keys.clear();
+        pulledTrack.keys.push_back({0.f, pulledLast});
+        size_t due = 0;
+        for(; due<waiting; ++due){
+            double at = (double(arrived[due].time) - blockStartMs)*44100/1000 + pickDelay;
+            if(at >= double(out.size())) break;
+            //late picks sound at the start of the block, so the events keep their order
+            float time = std::clamp(float(at/double(out.size())), 0.f, 1.f);
+            pulledTrack.keys.push_back({time, arrived[due].pick});
+            pulledLast = arrived[due].pick;
+        }
+        std::copy(arrived.begin()+due, arrived.begin()+waiting, arrived.begin());
+        waiting -= due;
+        pulledTrack.keys.push_back({1.f, pulledLast});
+
+        pulledSubsteps.store(stringsim.renderStable(out, pulledTrack, 44100.f/timeScale), std::memory_order_relaxed);
+        body.process(out);
+        audioClock += out.size();
+        if(shownLock.try_lock()){
+            shown = stringsim.string;
+            shownLock.unlock();
+        }
+    };
+
+    //declared after everything render uses, so the device closes before they go away
+    AudioStream austr(44100, deviceBlock);
+    if(pullAudio){
+        austr.setRenderer(render);
+        std::cout << "a pick sounds after a ui frame, two device blocks of up to " << deviceBlock
+            << " samples and the " << body.latency() << " samples of the body\n";
+    }
+
+    //the pick for a mouse at screen position p
+    auto pickAt = [&](vec2 p, bool held){
+        Pick pick = {0,0,0};
+        pick.active = gra.heldAt(env, p, held);
+        if(pick.active){
+            pick.pos = gra.localPosition(env, p);
+            pick.pos.y = pick.pos.y*(gra.maxy-gra.miny)+gra.miny;
+            pick.radius = 0.015f;
+        }
+        return pick;
+    };
 
     while(!env.getwin().should_close()){
         //generate new pick
@@ -34,24 +132,57 @@ int main() {
             thispick.radius = 0.015f;
         }
 
-        //simulate and queue audio samples, interpolating picks
-        uint numtoQueue = std::min(austr.numQueuedIn(env.getFrameTime()), 10000u);
-        uint substeps = 1;
-        vec2 pickstep = (thispick.pos-lastpick.pos)*(1.f/float(numtoQueue*substeps));
-        for(uint i = 0; i<numtoQueue; ++i){
-            float samp = 0;
-            for(int s = 0; s<substeps; ++s){
-                lastpick.pos += pickstep;
-                samp = stringsim.stepStroked(lastpick);
+        TDT4102::AnimationWindow& win = env.getwin();
+        if(pullAudio){
+            //hand the mouse events of the last frame to the audio thread, which renders them when it needs to
+            for(const TDT4102::MouseEvent& event : win.get_mouse_events())
+                posted.push({event.timestamp, pickAt(vec2(event.position), event.leftButton)});
+            posted.push({win.get_event_time(), thispick});
+            //a long frame raises the delay at once, and it decays slowly back to the usual frame
+            uint frame = uint(double(env.getFrameTime())*44100/1000000);
+            frameSamples.store(std::max(frame, frameSamples.load(std::memory_order_relaxed)*127/128), std::memory_order_relaxed);
+
+            uint chosen = pulledSubsteps.load(std::memory_order_relaxed);
+            if(chosen != substeps){
+                substeps = chosen;
+                std::cout << "stepping at " << 44100.f/timeScale*float(substeps) << " Hz, " << substeps << " steps per sample\n";
+            }
+            lastpick = thispick;
+
+            std::lock_guard<std::mutex> guard(shownLock);
+            gra.load(shown, fetchY);
+        }
+        else{
+            //the pick follows the mouse events of the last frame at their own times within the block,
+            //so a gesture keeps its shape instead of being smeared over the frame
+            uint32_t eventsFrom = win.get_previous_event_time();
+            float eventSpan = float(std::max(win.get_event_time()-eventsFrom, 1u));
+            track.keys.clear();
+            track.keys.push_back({0.f, lastpick});
+            for(const TDT4102::MouseEvent& event : win.get_mouse_events()){
+                float time = std::clamp(float(int32_t(event.timestamp-eventsFrom))/eventSpan, 0.f, 1.f);
+                track.keys.push_back({time, pickAt(vec2(event.position), event.leftButton)});
+            }
+            track.keys.push_back({1.f, thispick});
+
+            //simulate and queue audio samples
+            uint numtoQueue = std::min(austr.numQueuedIn(env.getFrameTime()), 10000u);
+            block.resize(numtoQueue);
+            uint chosen = stringsim.renderStable(block, track, 44100.f/timeScale);
+            if(chosen != substeps){
+                substeps = chosen;
+                std::cout << "stepping at " << 1.f/stringsim.stepSize << " Hz, " << substeps << " steps per sample\n";
             }
-            austr.queueSample(samp);
+            body.process(block);
+            austr.queueSamples(block);
+            lastpick = thispick;
+
+            gra.load(stringsim.string, fetchY);
         }
-        lastpick = thispick;
 
         //user communication
-        gra.load(stringsim.string, fetchY);
         env.control();
         env.render();
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -1,22 +1,47 @@
 #pragma once
 
 #include <iostream>
-#include <windows.h>
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <span>
+#include <thread>
+#include <vector>
 
+//the audio backend is picked at build time, by the audio_backend option of meson.build.
+//without one, windows uses waveform audio and everything else SDL.
+//SDL plays headless on its dummy driver, or writes to a file with the disk driver,
+//chosen through the SDL_AUDIODRIVER and SDL_DISKAUDIOFILE environment variables
+#if !defined(AUDIO_BACKEND_SDL) && !defined(AUDIO_BACKEND_WAVEOUT)
+#ifdef _WIN32
+#define AUDIO_BACKEND_WAVEOUT
+#else
+#define AUDIO_BACKEND_SDL
+#endif
+#endif
+
+#ifdef AUDIO_BACKEND_WAVEOUT
+#include <windows.h>
 
 //for the windows multimedia waveform audio documentation, see
 //https://learn.microsoft.com/en-us/windows/win32/multimedia/devices-and-data-types
 //and
 //https://learn.microsoft.com/en-us/windows/win32/multimedia/waveform-functions
 #include <mmeapi.h>
-#include <stdint.h>
-#include <math.h>
-#include <thread>
-#include <vector>
-//#include <mutex>
+#endif
+
+#ifdef AUDIO_BACKEND_SDL
+#include <SDL.h>
+#endif
 
 #include "myvecs.h"
+#include "mySimd.h"
+#include "myThreads.h"
 
+#ifdef AUDIO_BACKEND_WAVEOUT
 void CALLBACK waveOutCallback(HWAVEOUT hwo, UINT uMsg, DWORD_PTR dwInstance, DWORD_PTR dwParam1, DWORD_PTR dwParam2);
 
 //struct that is passed along with the audio buffer header
@@ -24,32 +49,15 @@ void CALLBACK waveOutCallback(HWAVEOUT hwo, UINT uMsg, DWORD_PTR dwInstance, DWO
 struct audioBufferInfo{
 	std::vector<int16_t>* boundVector;
 };
+#endif
 
-//as the waveOutCallback function executes on a seperate thread
-//the audio stream buffer vector needs to be thread-safe
-template<typename T>
-struct ThreadAdaptedVector{
-	std::vector<T> vec;
-	CRITICAL_SECTION cs;
-
-	ThreadAdaptedVector(){
-		InitializeCriticalSection(&cs);
-	}
-	~ThreadAdaptedVector(){
-		DeleteCriticalSection(&cs);
-	}
-	void enter(){
-		EnterCriticalSection(&cs);
-	}
-	void exit(){
-		LeaveCriticalSection(&cs);
-	}
-
-};
+#ifdef AUDIO_BACKEND_SDL
+void sdlAudioCallback(void* userdata, Uint8* stream, int len);
+#endif
 
 class AudioStream{
 private:
-	bool shouldClose = 0; //communicates with waveOutCallback to close the stream
+	std::atomic<bool> shouldClose{false}; //communicates with the callback to close the stream
 	uint sampleRate;
 	uint sampleBlockSize;
 	
@@ -59,9 +67,16 @@ private:
 	//if the last block had too few samples, the rate is sped up
 	//if the last block had too many, it is slowed down
 	//this is done by a P regulator
-	double regSampleRate;
+	std::atomic<double> regSampleRate;
 	double kp = 0.5;
 
+	//sets regSampleRate from the number of samples queued when the device asked for more
+	void regulate(uint measured){
+		double e = double(sampleBlockSize)-double(measured);
+		regSampleRate = std::max(double(sampleRate)+e*kp, 0.);
+	}
+
+#ifdef AUDIO_BACKEND_WAVEOUT
 	WAVEFORMATEX wfx;
 	HWAVEOUT waveOut;
 
@@ -69,12 +84,79 @@ private:
 	std::vector<int16_t> buff1, buff2;
 	WAVEHDR waveHdr1, waveHdr2;
 	audioBufferInfo waveHdr1Inf, waveHdr2Inf;
+#endif
+
+#ifdef AUDIO_BACKEND_SDL
+	SDL_AudioDeviceID device = 0;
+	//held by the callback when the queue runs dry
+	int16_t lastSample = 0;
+#endif
+
+	//pull mode, see setRenderer
+	std::function<void(std::span<float>)> renderer;
+	std::atomic<bool> pulling{false};
+	std::vector<float> pulled;
+
+	//fills n samples of out from the renderer, a piece of pulled at a time
+	void pull(int16_t* out, uint n){
+		for(uint i = 0; i<n;){
+			uint count = std::min(n-i, uint(pulled.size()));
+			renderer(std::span<float>(pulled.data(), count));
+			toInt16(pulled.data(), out+i, count, false);
+			i += count;
+		}
+	}
 
-	//std::mutex queWriteControl;
-	ThreadAdaptedVector<int16_t> que;
+	//samples from the simulation to the callback, which executes on a seperate thread.
+	//neither side ever blocks on the other, and the callback never allocates
+	SpscRing<int16_t> que;
+
+	//conversion to int16_t, 8 samples at a time in vector extension rows
+	static constexpr size_t Lanes = 8;
+	typedef ::Row<float, Lanes> Row;
+	typedef ::Row<int32_t, Lanes> IntRow;
+	typedef ::Row<uint32_t, Lanes> BitRow;
+	typedef ::Row<int16_t, Lanes> ShortRow;
+
+	//xorshift generators for the dither, one per lane
+	BitRow ditherState = {0x9e3779b9u, 0x7f4a7c15u, 0x85ebca6bu, 0xc2b2ae35u,
+		0x27d4eb2fu, 0x165667b1u, 0xd3a2646cu, 0xfd7046c5u};
+
+	//uniform values in [0, 1)
+	void ditherUniform(Row& u){
+		ditherState ^= ditherState << 13;
+		ditherState ^= ditherState >> 17;
+		ditherState ^= ditherState << 5;
+		u = __builtin_convertvector(ditherState >> 8, Row)*(1.f/16777216.f);
+	}
+
+	//scales, dithers, clips to the range of int16_t, and rounds to nearest.
+	//the last partial row goes through a padded copy, so every sample takes the same path
+	void toInt16(const float* in, int16_t* out, size_t n, bool dither){
+		const Row top = Row{} + float(INT16_MAX);
+		const Row half = Row{} + 0.5f;
+		for(size_t i = 0; i<n; i += Lanes){
+			size_t count = std::min(Lanes, n-i);
+			Row v = {};
+			memcpy(&v, in+i, count*sizeof(float));
+			v *= float(INT16_MAX);
+			if(dither){
+				Row a, b;
+				ditherUniform(a);
+				ditherUniform(b);
+				v += a - b;
+			}
+			v = v > top ? top : v;
+			v = v < -top ? -top : v;
+			v += v < 0 ? -half : half;
+			ShortRow s = __builtin_convertvector(__builtin_convertvector(v, IntRow), ShortRow);
+			memcpy(out+i, &s, count*sizeof(int16_t));
+		}
+	}
 
+#ifdef AUDIO_BACKEND_WAVEOUT
 	bool openConfigured(){
-		shouldClose = 0;
+		shouldClose = false;
 		//construct format tag
 		wfx.wFormatTag = WAVE_FORMAT_PCM;
 		wfx.nChannels = 1;              // Mono audio
@@ -109,17 +191,52 @@ private:
 		return 0;
 	}
 	void closeStream(){
-		shouldClose = 1;
+		shouldClose = true;
 		waveOutUnprepareHeader(waveOut, &waveHdr1, sizeof(WAVEHDR));
     	waveOutUnprepareHeader(waveOut, &waveHdr2, sizeof(WAVEHDR));
 		waveOutReset(waveOut);
 		auto check = waveOutClose(waveOut);
 		if (check != MMSYSERR_NOERROR) std::cerr << "error on stream close\n";
 	}
+#endif
+
+#ifdef AUDIO_BACKEND_SDL
+	bool openConfigured(){
+		shouldClose = false;
+		SDL_AudioSpec want, have;
+		SDL_zero(want);
+		want.freq = int(sampleRate);
+		want.format = AUDIO_S16SYS;
+		want.channels = 1;
+		//the device buffer, a power of two of about half a block
+		want.samples = 64;
+		while(want.samples*4u <= sampleBlockSize && want.samples < 8192) want.samples *= 2;
+		want.callback = sdlAudioCallback;
+		want.userdata = this;
+		//SDL converts to whatever the device plays
+		device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+		if(!device){
+			std::cerr << "Error opening audio device: " << SDL_GetError() << std::endl;
+			return 1;
+		}
+		SDL_PauseAudioDevice(device, 0);
+		return 0;
+	}
+	void closeStream(){
+		shouldClose = true;
+		if(device) SDL_CloseAudioDevice(device);
+		device = 0;
+	}
+#endif
 
 public:
 
+#ifdef AUDIO_BACKEND_WAVEOUT
 	friend void CALLBACK waveOutCallback(HWAVEOUT hwo, UINT uMsg, DWORD_PTR dwInstance, DWORD_PTR dwParam1, DWORD_PTR dwParam2);
+#endif
+#ifdef AUDIO_BACKEND_SDL
+	friend void sdlAudioCallback(void* userdata, Uint8* stream, int len);
+#endif
 
 	//returns 1 for error
 	bool reconfigure(){
@@ -127,38 +244,69 @@ public:
 		return openConfigured();
 	}
 	AudioStream(uint sampleRate = 44100, uint blockSize = 2000)
-		:sampleRate(sampleRate), sampleBlockSize(blockSize),
-		buff1(blockSize*3, 0), buff2(blockSize*3, 0)
+		:sampleRate(sampleRate), sampleBlockSize(blockSize), regSampleRate(sampleRate),
+#ifdef AUDIO_BACKEND_WAVEOUT
+		buff1(std::max(blockSize*3, 1000u), 0), buff2(std::max(blockSize*3, 1000u), 0),
+#endif
+		que(size_t(sampleRate)*2)
 	{
+#ifdef AUDIO_BACKEND_SDL
+		if(SDL_InitSubSystem(SDL_INIT_AUDIO) != 0)
+			std::cerr << "Error starting SDL audio: " << SDL_GetError() << std::endl;
+#endif
 		openConfigured();
 	}
 	~AudioStream(){
 		closeStream();
+#ifdef AUDIO_BACKEND_SDL
+		SDL_QuitSubSystem(SDL_INIT_AUDIO);
+#endif
 	}
 
 	double getSampleRate() const {return regSampleRate;}
 	double getInternalSampleRate() const {return sampleRate;}
 	uint getDesiredBlockSize() const {return sampleBlockSize;}
-	uint getBlockSize() const {return uint(que.vec.size());}
+	uint getBlockSize() const {return uint(que.size());}
 
-	//take an int16_t, with unbounded max and min value
+	//take an int16_t, with unbounded max and min value.
+	//samples that do not fit in the queue are dropped
 	void queueSample(const int16_t& samp){
-		//std::lock_guard<std::mutex> guard(queWriteControl);
-		que.enter();
-		que.vec.push_back(samp);
-		que.exit();
+		que.push(samp);
 	}
-	//take a floating point value with minimum -1 and maximum 1 value
+	//take a floating point value with minimum -1 and maximum 1 value,
+	//values past those are clipped
 	void queueSample(const double& samp){
-		que.enter();
-		que.vec.push_back(int16_t(samp*double(INT16_MAX)));
-		que.exit();
+		queueSample(float(samp));
 	}
 	void queueSample(const float& samp){
-		que.enter();
-		que.vec.push_back(int16_t(samp*float(INT16_MAX)));
-		que.exit();
+		queueSamples(std::span<const float>(&samp, 1));
+	}
+	//queue a block at once, returns how many samples fit
+	size_t queueSamples(std::span<const int16_t> samps){
+		return que.push(samps);
+	}
+	//queue a block of floating point values straight into the queue, clipped as queueSample.
+	//with dither, triangular noise of one step of int16_t is added before rounding,
+	//so quiet passages fade into noise instead of breaking up into steps
+	size_t queueSamples(std::span<const float> samps, bool dither = false){
+		return que.pushWith(samps.size(), [&](int16_t* to, size_t from, size_t n){
+			toInt16(samps.data()+from, to, n, dither);
+		});
+	}
+
+	//pull mode: instead of taking samples from the queue, the callback asks render for exactly
+	//the samples the device needs, on the audio thread, in pieces of at most a few blocks.
+	//nothing is queued ahead of the device, so the latency is that of its buffers, two of blockSize for waveOut
+	//and one of about blockSize/4 for SDL, plus whatever render adds. pick a small blockSize, a few hundred samples.
+	//the rate stays at sampleRate.
+	//set it once, before render can be called
+	void setRenderer(std::function<void(std::span<float>)> render){
+		renderer = std::move(render);
+		pulled.assign(std::max(sampleBlockSize*3, 16384u), 0.f);
+		regSampleRate = sampleRate;
+		pulling.store(true, std::memory_order_release);
 	}
+	bool isPulling() const {return pulling.load(std::memory_order_acquire);}
 
 	//get the number of samples wanted in time microseconds
 	//regulated to avoid buffer over/underflow
@@ -171,6 +319,7 @@ public:
 //get rid of pesky compiler warnings
 #define UNUSED(x) (void)(x)
 
+#ifdef AUDIO_BACKEND_WAVEOUT
 void CALLBACK waveOutCallback(HWAVEOUT hwo, UINT uMsg, DWORD_PTR dwInstance, DWORD_PTR dwParam1, DWORD_PTR dwParam2) {
     UNUSED(dwParam2); 
 
@@ -191,29 +340,29 @@ void CALLBACK waveOutCallback(HWAVEOUT hwo, UINT uMsg, DWORD_PTR dwInstance, DWO
     // Release the audio buffer
     waveOutUnprepareHeader(hwo, pWaveHdr, sizeof(WAVEHDR));
 
-	//swap buffers
-	pinf->boundVector->clear();
-	pstrm->que.enter();
-	std::swap(pstrm->que.vec, *pinf->boundVector);
+	if(pstrm->isPulling()){
+		pstrm->pull(pinf->boundVector->data(), pstrm->sampleBlockSize);
+		pWaveHdr->lpData = LPSTR(pinf->boundVector->data());
+		pWaveHdr->dwUser = DWORD_PTR(pinf);
+		pWaveHdr->dwBufferLength = pstrm->sampleBlockSize * sizeof(int16_t);
+		waveOutPrepareHeader(hwo, pWaveHdr, sizeof(WAVEHDR));
+		waveOutWrite(hwo, pWaveHdr, sizeof(WAVEHDR));
+		return;
+	}
 
-	//format for new buffer data
-	uint writtenSize = uint(pinf->boundVector->size());
-	uint writtenSizebuf = writtenSize;
+	//take the queued samples, but leave anything past a normal block in the queue.
+	//this is essential to prevent one buffer from becoming very big, and one very small
+	std::vector<int16_t>& buff = *pinf->boundVector;
+	uint queued = uint(pstrm->que.size());
+	uint writtenSizebuf = queued;
+	uint writtenSize = queued > pstrm->sampleBlockSize+500 ? pstrm->sampleBlockSize : queued;
+	writtenSize = uint(pstrm->que.pop(std::span<int16_t>(buff.data(), writtenSize)));
 
-	//append zeroes to extend if too short
+	//append copies of the last sample to extend if too short
 	if(writtenSize < 1000){
-		if(writtenSize == 0) pinf->boundVector->push_back(0);
+		if(writtenSize == 0) buff[0] = 0;
+		std::fill(buff.begin()+std::max(writtenSize, 1u), buff.begin()+1000, buff[std::max(writtenSize, 1u)-1]);
 		writtenSize = 1000;
-		for(uint i = (uint)pinf->boundVector->size(); i<1000; ++i)
-			pinf->boundVector->push_back(pinf->boundVector->at(i-1));
-	}
-	//move into the next stack if too long
-	//this is essential to prevent one buffer from becoming very big, and one very small
-	else if(writtenSize > pstrm->sampleBlockSize+500){
-		for(uint i = pstrm->sampleBlockSize; i<writtenSize; ++i){
-			pstrm->que.vec.push_back(pinf->boundVector->at(i));
-		}
-		writtenSize = pstrm->sampleBlockSize;
 	}
 
 	//give the data to waveform audio
@@ -226,15 +375,33 @@ void CALLBACK waveOutCallback(HWAVEOUT hwo, UINT uMsg, DWORD_PTR dwInstance, DWO
 	waveOutWrite(hwo, pWaveHdr, sizeof(WAVEHDR));
 
 	//P-regulator for desired sample rate
-	double push = pstrm->sampleBlockSize;
-	double measure = writtenSizebuf;
-	double kp = pstrm->kp;
-	double& dest = pstrm->regSampleRate;
+	pstrm->regulate(writtenSizebuf);
+}
+#endif
+
+#ifdef AUDIO_BACKEND_SDL
+//SDL asks for len bytes of samples whenever the device needs them.
+//the queue is drained straight into the device buffer, and if it runs dry the last sample is held
+void sdlAudioCallback(void* userdata, Uint8* stream, int len){
+	AudioStream* pstrm = (AudioStream*)userdata;
+	int16_t* out = reinterpret_cast<int16_t*>(stream);
+	uint wanted = uint(len)/uint(sizeof(int16_t));
+	if(pstrm->shouldClose || wanted == 0){
+		memset(stream, 0, size_t(len));
+		return;
+	}
+
+	if(pstrm->isPulling()){
+		pstrm->pull(out, wanted);
+		return;
+	}
 
-	double e = push-measure;
-	dest = double(pstrm->sampleRate)+e*kp;
-	if(dest < 0) dest = 0;
+	uint queued = uint(pstrm->que.size());
+	uint written = uint(pstrm->que.pop(std::span<int16_t>(out, wanted)));
+	std::fill(out+written, out+wanted, written ? out[written-1] : pstrm->lastSample);
+	pstrm->lastSample = out[wanted-1];
 
-	pstrm->que.exit();
-	
-}
\ No newline at end of file
+	//P-regulator for desired sample rate, aiming for a block of samples queued
+	pstrm->regulate(queued);
+}
+#endif
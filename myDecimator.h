@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <span>
+#include <vector>
+
+#include "mySimd.h"
+
+//lowers the sample rate by an integer factor behind an anti-aliasing lowpass.
+//the lowpass is a windowed sinc of factor*tapsPerPhase taps, cut off a little below the new nyquist frequency.
+//only every factor-th output of the filter is computed, each as one dot product over the last taps inputs,
+//which is the polyphase form: output n sums phase p of the filter over every factor-th input.
+//the dot products run in vector extension rows, with the taps stored reversed and padded to whole rows.
+//a factor of 1 passes samples through unchanged, only delayed as much as the output of a factor of 2,
+//so changing between them does not shift the signal in time.
+//storage for factors up to maxFactor and maxInput inputs per pass is taken up front, so process() and
+//setFactor() do not allocate on an audio thread. longer blocks are decimated maxInput inputs at a time.
+//setFactor() keeps the inputs of the filter, resampled to the new rate, so the output does not restart from silence
+class PolyphaseDecimator{
+private:
+    static constexpr size_t Lanes = 8;
+    typedef ::Row<float, Lanes> Row;
+
+    uint m = 0;
+    uint phaseTaps;
+    size_t length = 1;
+    size_t maxInput;
+    //the taps in reverse, so output n is the dot product with the inputs from its window's start
+    AlignedVector<float> reversed;
+    //the last kept() inputs followed by the inputs being decimated
+    AlignedVector<float> buffer;
+    //the kept inputs while setFactor() resamples them
+    AlignedVector<float> previous;
+
+
+    //filter length of a factor, in whole rows
+    size_t lengthOf(uint factor) const {
+        return factor == 1 ? 1 : (size_t(factor)*phaseTaps+Lanes-1)/Lanes*Lanes;
+    }
+    //inputs kept between passes. a factor of 1 keeps as many as a factor of 2 would,
+    //only for a later setFactor() to start from
+    size_t kept() const {
+        return (m == 1 ? lengthOf(2) : length)-1;
+    }
+    //delay of a factor of 1, that of a factor of 2 in output samples
+    size_t passDelay() const {
+        return size_t(lround(double(lengthOf(2)-1)/4));
+    }
+
+public:
+    PolyphaseDecimator(uint factor = 1, uint tapsPerPhase = 32, uint maxFactor = 16, size_t maxInput = 4096)
+        :phaseTaps(std::max(1u, tapsPerPhase)), maxInput(std::max(size_t(1), maxInput))
+    {
+        size_t most = std::max(lengthOf(std::max(2u, maxFactor)), lengthOf(std::max(1u, factor)));
+        reversed.assign(most, 0.f);
+        buffer.assign(most-1 + std::max(this->maxInput, size_t(std::max(maxFactor, factor))), 0.f);
+        previous.assign(most-1, 0.f);
+        setFactor(factor);
+    }
+
+    uint factor() const {return m;}
+    //delay of the filter in input samples
+    double delay() const {return m == 1 ? double(passDelay()) : double(length-1)/2;}
+
+    //switches to another factor. only a factor above the largest one so far allocates
+    void setFactor(uint factor){
+        factor = std::max(1u, factor);
+        if(factor == m) return;
+        size_t oldKept = m ? kept() : 0;
+        uint oldM = m ? m : factor;
+        std::copy(buffer.begin(), buffer.begin()+oldKept, previous.begin());
+
+        m = factor;
+        length = lengthOf(m);
+        if(length > reversed.size()){
+            reversed.resize(length);
+            previous.resize(length-1);
+        }
+        buffer.resize(std::max(buffer.size(), kept() + std::max(maxInput, size_t(m))));
+
+        //the kept inputs at the new rate, interpolated linearly from those at the old one
+        size_t newKept = kept();
+        for(size_t i = 0; i<newKept; ++i){
+            double age = double(newKept-1-i)*double(oldM)/double(m);
+            double at = double(oldKept)-1-age;
+            size_t below = at < 0 ? 0 : size_t(at);
+            float f = float(at-double(below));
+            buffer[i] = at < 0 || !oldKept ? 0.f :
+                below+1 < oldKept ? previous[below]*(1-f) + previous[below+1]*f : previous[oldKept-1];
+        }
+
+        if(m == 1){
+            reversed[0] = 1;
+            return;
+        }
+        //blackman windowed sinc, cut off at 0.9 times the nyquist frequency of the output
+        double cutoff = 0.45/double(m);
+        double centre = double(length-1)/2;
+        double sum = 0;
+        for(size_t k = 0; k<length; ++k){
+            double t = double(k)-centre;
+            double sinc = t == 0 ? 2*cutoff : sin(2*M_PI*cutoff*t)/(M_PI*t);
+            double x = 2*M_PI*double(k)/double(length-1);
+            double window = 0.42 - 0.5*cos(x) + 0.08*cos(2*x);
+            reversed[length-1-k] = float(sinc*window);
+            sum += sinc*window;
+        }
+        for(size_t k = 0; k<length; ++k) reversed[k] = float(reversed[k]/sum);
+    }
+
+    //decimates out.size()*factor() samples of in into out
+    void process(std::span<const float> in, std::span<float> out){
+        size_t keep = kept();
+        size_t chunk = std::max(size_t(1), maxInput/m);
+        for(size_t done = 0; done<out.size(); done += chunk){
+            size_t n = std::min(chunk, out.size()-done);
+            size_t count = n*m;
+            std::copy(in.begin()+done*m, in.begin()+done*m+count, buffer.begin()+keep);
+            if(m == 1){
+                size_t from = keep-passDelay();
+                std::copy(buffer.begin()+from, buffer.begin()+from+count, out.begin()+done);
+            }
+            else for(size_t k = 0; k<n; ++k){
+                //the window of output k ends at its last input, k*m + m-1
+                const float* x = buffer.data() + keep+1-length + k*m + m-1;
+                Row sum = {}, tap, value;
+                for(size_t t = 0; t<length; t += Lanes){
+                    loadRow(tap, reversed.data()+t);
+                    loadRow(value, x+t);
+                    sum += tap*value;
+                }
+                float total = 0;
+                for(size_t l = 0; l<Lanes; ++l) total += sum[l];
+                out[done+k] = total;
+            }
+            std::copy(buffer.begin()+count, buffer.begin()+count+keep, buffer.begin());
+        }
+    }
+};
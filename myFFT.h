@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <complex>
+#include <vector>
+
+#include "mySimd.h"
+
+//fast fourier transform of n real values, for n a power of two of at least 4.
+//the n/2+1 bins from 0 to the nyquist frequency are kept as separate real and imaginary arrays,
+//so loops over spectra vectorize. the real values are packed into n/2 complex ones, transformed by
+//an iterative radix 2 fft, and split into the bins of the even and odd values.
+//inverse(forward(x)) gives back x times n
+class RealFFT{
+private:
+    typedef std::complex<float> Complex;
+
+    size_t n;
+    size_t half;
+    //exp(-2*pi*i*k/half) for the butterflies, and exp(-2*pi*i*k/n) for the split
+    std::vector<Complex> twiddles, splits;
+    std::vector<uint32_t> reversed;
+    std::vector<Complex> work;
+
+    void transform(Complex* z, bool inverse){
+        for(size_t k = 0; k<half; ++k)
+            if(k < reversed[k]) std::swap(z[k], z[reversed[k]]);
+        for(size_t span = 1; span<half; span *= 2){
+            size_t stride = half/(2*span);
+            for(size_t start = 0; start<half; start += 2*span){
+                for(size_t k = 0; k<span; ++k){
+                    Complex w = twiddles[k*stride];
+                    if(inverse) w = std::conj(w);
+                    Complex a = z[start+k];
+                    Complex b = z[start+k+span]*w;
+                    z[start+k] = a+b;
+                    z[start+k+span] = a-b;
+                }
+            }
+        }
+    }
+
+public:
+    RealFFT(size_t size)
+        :n(size), half(size/2), twiddles(half/2), splits(half+1), reversed(half), work(half)
+    {
+        for(size_t k = 0; k<twiddles.size(); ++k)
+            twiddles[k] = std::polar(1., -2*M_PI*double(k)/double(half));
+        for(size_t k = 0; k<=half; ++k)
+            splits[k] = std::polar(1., -2*M_PI*double(k)/double(n));
+        uint bits = 0;
+        while((size_t(1) << bits) < half) ++bits;
+        for(size_t k = 0; k<half; ++k){
+            uint32_t r = 0;
+            for(uint b = 0; b<bits; ++b) r |= uint32_t((k >> b) & 1) << (bits-1-b);
+            reversed[k] = r;
+        }
+    }
+
+    size_t size() const {return n;}
+    size_t bins() const {return half+1;}
+
+    //bins() values each of re and im from n values of x
+    void forward(const float* x, float* re, float* im){
+        for(size_t k = 0; k<half; ++k) work[k] = Complex(x[2*k], x[2*k+1]);
+        transform(work.data(), false);
+        for(size_t k = 0; k<=half; ++k){
+            Complex z = work[k%half];
+            Complex mirror = std::conj(work[(half-k)%half]);
+            Complex even = (z+mirror)*0.5f;
+            Complex odd = (z-mirror)*Complex(0, -0.5f);
+            Complex bin = even + splits[k]*odd;
+            re[k] = bin.real();
+            im[k] = bin.imag();
+        }
+    }
+
+    //n values of x from bins() values each of re and im, scaled by n
+    void inverse(const float* re, const float* im, float* x){
+        for(size_t k = 0; k<half; ++k){
+            Complex bin(re[k], im[k]);
+            Complex mirror = std::conj(Complex(re[half-k], im[half-k]));
+            Complex even = bin+mirror;
+            Complex odd = (bin-mirror)*std::conj(splits[k]);
+            work[k] = even + Complex(0, 1)*odd;
+        }
+        transform(work.data(), true);
+        for(size_t k = 0; k<half; ++k){
+            x[2*k] = work[k].real();
+            x[2*k+1] = work[k].imag();
+        }
+    }
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <new>
+#include <vector>
+
+//allocator that hands out memory aligned to a cache line,
+//so simd loads from the start of an array never straddle two lines
+template<typename T, size_t Alignment = 64>
+struct AlignedAllocator{
+    typedef T value_type;
+    template<typename U> struct rebind{
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() = default;
+    template<typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&){}
+
+    T* allocate(size_t n){
+        return static_cast<T*>(::operator new(n*sizeof(T), std::align_val_t(Alignment)));
+    }
+    void deallocate(T* p, size_t n){
+        ::operator delete(p, n*sizeof(T), std::align_val_t(Alignment));
+    }
+
+    template<typename U> bool operator==(const AlignedAllocator<U, Alignment>&) const {return true;}
+    template<typename U> bool operator!=(const AlignedAllocator<U, Alignment>&) const {return false;}
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+//Lanes values of T in a gcc vector extension, for the hand vectorized loops outside the per tier kernels.
+//the compiler picks the instructions for whatever it targets, and splits a row it has no register for.
+//loadRow and storeRow go through memcpy, so the memory needs no alignment.
+//rows are passed by reference, as wide vectors have no stable by-value abi below avx
+template<typename T, size_t Lanes>
+struct RowOf{
+    typedef T type __attribute__((vector_size(sizeof(T)*Lanes)));
+};
+template<typename T, size_t Lanes>
+using Row = typename RowOf<T, Lanes>::type;
+
+template<typename R, typename T>
+inline void loadRow(R& r, const T* p){
+    memcpy(&r, p, sizeof(R));
+}
+template<typename T, typename R>
+inline void storeRow(T* p, const R& r){
+    memcpy(p, &r, sizeof(R));
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MYSIMD_X86 1
+#include <immintrin.h>
+#endif
+
+//instruction set tiers the hand written kernels are compiled for
+enum class SimdLevel{scalar, sse, avx2, avx512};
+
+inline const char* simdLevelName(SimdLevel level){
+    switch(level){
+        case SimdLevel::sse: return "sse2";
+        case SimdLevel::avx2: return "avx2+fma";
+        case SimdLevel::avx512: return "avx512f";
+        default: return "scalar";
+    }
+}
+
+//whether a tier is usable on this machine.
+//the builtins read cpuid, and for the avx tiers also check that the os saves the wide registers
+inline bool simdLevelSupported(SimdLevel level){
+#ifdef MYSIMD_X86
+    __builtin_cpu_init();
+    switch(level){
+        case SimdLevel::sse: return __builtin_cpu_supports("sse2");
+        case SimdLevel::avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case SimdLevel::avx512: return __builtin_cpu_supports("avx512f");
+        default: return true;
+    }
+#else
+    return level == SimdLevel::scalar;
+#endif
+}
+
+//the best supported tier, detected once on first use
+inline SimdLevel simdLevel(){
+    static const SimdLevel level = [](){
+        for(SimdLevel l : {SimdLevel::avx512, SimdLevel::avx2, SimdLevel::sse})
+            if(simdLevelSupported(l)) return l;
+        return SimdLevel::scalar;
+    }();
+    return level;
+}
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#include "myvecs.h"
+
+//a fixed set of worker threads that runs batches of indexed tasks.
+//each batch is split into one contiguous range of indices per worker.
+//a worker takes tasks from the back of its own range, and when it runs dry
+//steals from the front of the others, so uneven task costs even out.
+//the thread calling run() works as worker 0, so a pool of one thread runs everything inline
+class WorkStealingPool{
+private:
+    //range of task indices owned by one worker, guarded by a spinlock.
+    //padded to a cache line so workers do not contend on each others ranges
+    struct alignas(64) Queue{
+        std::atomic_flag busy = ATOMIC_FLAG_INIT;
+        size_t begin = 0;
+        size_t end = 0;
+
+        void lock(){
+            while(busy.test_and_set(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+        void unlock(){
+            busy.clear(std::memory_order_release);
+        }
+        bool popBack(size_t& task){
+            lock();
+            bool got = begin < end;
+            if(got) task = --end;
+            unlock();
+            return got;
+        }
+        bool stealFront(size_t& task){
+            lock();
+            bool got = begin < end;
+            if(got) task = begin++;
+            unlock();
+            return got;
+        }
+    };
+
+    uint threads;
+    std::unique_ptr<Queue[]> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    bool quitting = false;
+
+    //the current batch, type erased so run() does not allocate
+    void (*job)(void*, size_t) = nullptr;
+    void* jobData = nullptr;
+    std::atomic<size_t> remaining{0};
+
+    bool take(uint w, size_t& task){
+        if(queues[w].popBack(task)) return true;
+        for(uint i = 1; i<threads; ++i)
+            if(queues[(w+i)%threads].stealFront(task)) return true;
+        return false;
+    }
+
+    void work(uint w){
+        size_t task;
+        while(take(w, task)){
+            job(jobData, task);
+            if(remaining.fetch_sub(1, std::memory_order_acq_rel) == 1){
+                std::lock_guard<std::mutex> guard(mutex);
+                done.notify_all();
+            }
+        }
+    }
+
+    void workerLoop(uint w){
+        uint64_t seen = 0;
+        while(true){
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]{return quitting || generation != seen;});
+                if(quitting) return;
+                seen = generation;
+            }
+            work(w);
+        }
+    }
+
+public:
+    WorkStealingPool(uint threadCount = std::max(1u, std::thread::hardware_concurrency()))
+        :threads(std::max(1u, threadCount)), queues(new Queue[threads])
+    {
+        for(uint w = 1; w<threads; ++w)
+            workers.emplace_back(&WorkStealingPool::workerLoop, this, w);
+    }
+    ~WorkStealingPool(){
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            quitting = true;
+        }
+        wake.notify_all();
+        for(std::thread& t : workers) t.join();
+    }
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    uint threadCount() const {return threads;}
+
+    //calls task(i) for every i in [0, count) across the workers, and returns when all calls are done.
+    //the task must be safe to call concurrently for different indices
+    template<typename F>
+    void run(size_t count, F&& task){
+        if(count == 0) return;
+        job = [](void* data, size_t i){(*static_cast<std::remove_reference_t<F>*>(data))(i);};
+        jobData = (void*)&task;
+        remaining.store(count, std::memory_order_relaxed);
+        for(uint w = 0; w<threads; ++w){
+            queues[w].lock();
+            queues[w].begin = count*w/threads;
+            queues[w].end = count*(w+1)/threads;
+            queues[w].unlock();
+        }
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            ++generation;
+        }
+        wake.notify_all();
+
+        work(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]{return remaining.load(std::memory_order_acquire) == 0;});
+    }
+};
+
+//barrier for a fixed group of threads that spins instead of sleeping,
+//for the short waits between two simulation steps.
+//after a short spin it yields, so it degrades gracefully when there are more threads than cores
+class SpinBarrier{
+private:
+    const uint count;
+    std::atomic<uint> waiting{0};
+    std::atomic<uint> phase{0};
+
+public:
+    SpinBarrier(uint threads)
+        :count(threads){}
+
+    void arriveAndWait(){
+        uint p = phase.load(std::memory_order_acquire);
+        if(waiting.fetch_add(1, std::memory_order_acq_rel) == count-1){
+            waiting.store(0, std::memory_order_relaxed);
+            phase.fetch_add(1, std::memory_order_release);
+            return;
+        }
+        for(uint spins = 0; phase.load(std::memory_order_acquire) == p; ++spins){
+            if(spins < 64){
+#ifdef __SSE2__
+                _mm_pause();
+#endif
+            }
+            else std::this_thread::yield();
+        }
+    }
+};
+
+//a fixed group of threads that run one job together, such as stepping one chunk of a simulation each.
+//run(task) calls task(t) on every thread t of the group, the calling thread being thread 0,
+//and returns once all calls are done. the threads sleep between runs, and within a run they
+//keep in lockstep through barrier(), which run() also uses to wait for the end of the job
+class LockstepThreads{
+private:
+    uint count;
+    SpinBarrier sync;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    uint64_t generation = 0;
+    bool quitting = false;
+
+    //the current job, type erased as in WorkStealingPool
+    void (*job)(void*, uint) = nullptr;
+    void* jobData = nullptr;
+
+    void workerLoop(uint t){
+        uint64_t seen = 0;
+        while(true){
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]{return quitting || generation != seen;});
+                if(quitting) return;
+                seen = generation;
+            }
+            job(jobData, t);
+            sync.arriveAndWait();
+        }
+    }
+
+public:
+    LockstepThreads(uint threads)
+        :count(std::max(1u, threads)), sync(count)
+    {
+        for(uint t = 1; t<count; ++t)
+            workers.emplace_back(&LockstepThreads::workerLoop, this, t);
+    }
+    ~LockstepThreads(){
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            quitting = true;
+        }
+        wake.notify_all();
+        for(std::thread& w : workers) w.join();
+    }
+    LockstepThreads(const LockstepThreads&) = delete;
+    LockstepThreads& operator=(const LockstepThreads&) = delete;
+
+    uint threadCount() const {return count;}
+    SpinBarrier& barrier() {return sync;}
+
+    template<typename F>
+    void run(F&& task){
+        job = [](void* data, uint t){(*static_cast<std::remove_reference_t<F>*>(data))(t);};
+        jobData = (void*)&task;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            ++generation;
+        }
+        wake.notify_all();
+        task(0);
+        sync.arriveAndWait();
+    }
+};
+
+//lock free ring buffer between one producing and one consuming thread.
+//the capacity is rounded up to a power of two. each side only writes its own counter,
+//with release ordering after touching the values, so the other side sees them complete.
+//push and pop move as many values as fit or are there, and return how many that was
+template<typename T>
+class SpscRing{
+private:
+    std::vector<T> buffer;
+    size_t mask;
+    //values pushed and popped so far, the difference is the fill level
+    alignas(64) std::atomic<size_t> pushed{0};
+    alignas(64) std::atomic<size_t> popped{0};
+
+public:
+    SpscRing(size_t capacity)
+    {
+        size_t size = 1;
+        while(size < capacity) size *= 2;
+        buffer.resize(size);
+        mask = size-1;
+    }
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const {return buffer.size();}
+    //exact on either side, a lower bound for the producer and an upper one for the consumer otherwise
+    size_t size() const {
+        return pushed.load(std::memory_order_acquire) - popped.load(std::memory_order_acquire);
+    }
+
+    //producer side
+    size_t push(std::span<const T> values){
+        size_t at = pushed.load(std::memory_order_relaxed);
+        size_t count = std::min(values.size(), buffer.size() - (at - popped.load(std::memory_order_acquire)));
+        size_t first = std::min(count, buffer.size() - (at & mask));
+        std::copy(values.begin(), values.begin()+first, buffer.begin()+(at & mask));
+        std::copy(values.begin()+first, values.begin()+count, buffer.begin());
+        pushed.store(at+count, std::memory_order_release);
+        return count;
+    }
+    bool push(const T& value){
+        return push(std::span<const T>(&value, 1)) == 1;
+    }
+    //pushes up to count values written in place by write(to, from, n), which fills n values
+    //starting at to with values from to from+n of its source. called once or twice,
+    //as the free space may wrap around the end of the buffer
+    template<typename F>
+    size_t pushWith(size_t count, F&& write){
+        size_t at = pushed.load(std::memory_order_relaxed);
+        count = std::min(count, buffer.size() - (at - popped.load(std::memory_order_acquire)));
+        size_t first = std::min(count, buffer.size() - (at & mask));
+        if(first) write(buffer.data()+(at & mask), size_t(0), first);
+        if(count > first) write(buffer.data(), first, count-first);
+        pushed.store(at+count, std::memory_order_release);
+        return count;
+    }
+
+    //consumer side
+    size_t pop(std::span<T> values){
+        size_t at = popped.load(std::memory_order_relaxed);
+        size_t count = std::min(values.size(), pushed.load(std::memory_order_acquire) - at);
+        size_t first = std::min(count, buffer.size() - (at & mask));
+        std::copy(buffer.begin()+(at & mask), buffer.begin()+(at & mask)+first, values.begin());
+        std::copy(buffer.begin(), buffer.begin()+(count-first), values.begin()+first);
+        popped.store(at+count, std::memory_order_release);
+        return count;
+    }
+    bool pop(T& value){
+        return pop(std::span<T>(&value, 1)) == 1;
+    }
+    //skips up to count values without reading them
+    size_t drop(size_t count){
+        size_t at = popped.load(std::memory_order_relaxed);
+        count = std::min(count, pushed.load(std::memory_order_acquire) - at);
+        popped.store(at+count, std::memory_order_release);
+        return count;
+    }
+};
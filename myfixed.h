@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <iostream>
+
+//signed Q1.30 fixed point number: 32 bits, 30 of them fractional, covering [-2, 2).
+//sums saturate instead of wrapping, and products go through a 64 bit intermediate, rounded to nearest.
+//results only depend on integer operations, so they are identical on every compiler and simd width.
+//mixing with a double converts the double, except for products, which are computed and returned in double.
+//that way a chain like y*resistance*stepSize does not saturate halfway. it is meant for the odd per step correction, not for inner loops
+struct q30{
+    int32_t raw = 0;
+
+    static constexpr int fractionBits = 30;
+    static constexpr double one = double(int64_t(1) << fractionBits);
+
+    static constexpr int32_t saturate(int64_t v){
+        return v > INT32_MAX ? INT32_MAX : v < INT32_MIN ? INT32_MIN : int32_t(v);
+    }
+    static constexpr q30 fromRaw(int32_t r){
+        q30 q;
+        q.raw = r;
+        return q;
+    }
+    //the product of two raw values, shared with the simd kernels so both round the same way
+    static constexpr int32_t multiplyRaw(int32_t a, int32_t b){
+        return saturate((int64_t(a)*int64_t(b) + (int64_t(1) << (fractionBits-1))) >> fractionBits);
+    }
+
+    constexpr q30() = default;
+    q30(double v)
+        :raw(saturate(int64_t(llround(fmin(fmax(v*one, double(INT32_MIN)), double(INT32_MAX)))))){}
+
+    explicit operator float() const {return float(double(raw)/one);}
+    explicit operator double() const {return double(raw)/one;}
+
+    q30 operator-() const {return fromRaw(saturate(-int64_t(raw)));}
+    q30& operator+=(q30 b){raw = saturate(int64_t(raw)+b.raw); return *this;}
+    q30& operator-=(q30 b){raw = saturate(int64_t(raw)-b.raw); return *this;}
+    q30& operator*=(q30 b){raw = multiplyRaw(raw, b.raw); return *this;}
+    q30& operator*=(double b){return *this = *this*b;}
+
+    friend q30 operator+(q30 a, q30 b){return a += b;}
+    friend q30 operator-(q30 a, q30 b){return a -= b;}
+    friend q30 operator*(q30 a, q30 b){return a *= b;}
+    friend double operator*(q30 a, double b){return double(a)*b;}
+
+    friend bool operator==(q30 a, q30 b){return a.raw == b.raw;}
+    friend bool operator!=(q30 a, q30 b){return a.raw != b.raw;}
+    friend bool operator<(q30 a, q30 b){return a.raw < b.raw;}
+    friend bool operator>(q30 a, q30 b){return a.raw > b.raw;}
+    friend bool operator<=(q30 a, q30 b){return a.raw <= b.raw;}
+    friend bool operator>=(q30 a, q30 b){return a.raw >= b.raw;}
+};
+
+inline q30 abs(q30 a){
+    return a.raw < 0 ? -a : a;
+}
+
+inline std::ostream& operator<<(std::ostream& stream, q30 q){
+    return stream << double(q);
+}
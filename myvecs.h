@@ -197,7 +197,7 @@ template<typename T> struct quadt{
     }
 
 
-    bool contains(const vec2t<T>& vec){
+    bool contains(const vec2t<T>& vec) const{
         return
             vec.x>=lower.x && vec.x <= higher.x &&
             vec.y>=lower.y && vec.y <= higher.y;
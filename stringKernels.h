@@ -0,0 +1,672 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "mySimd.h"
+#include "myrandoms.h"
+#include "myfixed.h"
+
+//inner loops of String<T> for the structure of arrays layout.
+//all kernels work on the half open segment range [lo, hi),
+//where 0 < lo and hi <= size-1 so the fixed end points are never written
+
+//per step coefficients folded from the String parameters
+template<typename T>
+struct StringCoefficients{
+    T step;         //stepSize
+    T stiffness;    //segmentStiffness
+    T air;          //airResistance
+    T friction;     //elasticFriction
+    T stiffnessStep;//segmentStiffness*stepSize
+    T airStep;      //airResistance*stepSize
+    T frictionStep; //elasticFriction*stepSize
+};
+
+//curvature of each segment, the first pass of stepStroked.
+//reads y from lo-1 to hi
+template<typename T>
+void curvatureSoA(const T* __restrict y, T* __restrict curvature, size_t lo, size_t hi){
+    for(size_t i = lo; i<hi; ++i){
+        T dylw = y[i]-y[i-1];
+        T dyhg = y[i+1]-y[i];
+        curvature[i] = dylw-dyhg;
+    }
+}
+
+//velocity update of stepStroked, from the curvature of the first pass.
+//the reference loop lets the elastic friction offset of segment i-1 feed into the curvature of segment i,
+//which is the recurrence d[i] = J[i] + frictionStep*d[i-1] on the plain curvature J.
+//frictionStep is tiny (around 5e-7 with the default parameters), so the recurrence is unrolled two terms deep.
+//this keeps the loops free of carried dependencies, and matches the reference to rounding
+//as long as frictionStep^3 stays below the precision of T.
+//reads curvature from lo-2 to hi, where the two values before lo are zero at the fixed end
+template<typename T>
+void strokeVelocitiesSoA(T* __restrict y, T* __restrict dy, const T* __restrict curvature, size_t lo, size_t hi, const StringCoefficients<T>& c){
+    const T kh = c.stiffnessStep;
+    const T ah = c.airStep;
+    const T fh = c.frictionStep;
+    for(size_t i = lo; i<hi; ++i){
+        T ddy = curvature[i] + fh*(curvature[i-1] + fh*curvature[i-2]);
+        T v = dy[i] - ddy*kh;
+        dy[i] = v - v*ah;
+        y[i] -= ddy*fh;
+    }
+}
+
+//velocity update of stepNoFriction
+template<typename T>
+void freeVelocitiesSoA(const T* __restrict y, T* __restrict dy, size_t lo, size_t hi, const StringCoefficients<T>& c){
+    const T kh = c.stiffnessStep;
+    for(size_t i = lo; i<hi; ++i){
+        T dylw = y[i]-y[i-1];
+        T dyhg = y[i+1]-y[i];
+        dy[i] -= (dylw-dyhg)*kh;
+    }
+}
+
+//position update shared by both steps
+template<typename T>
+void integrateSoA(T* __restrict y, const T* __restrict dy, size_t lo, size_t hi, const StringCoefficients<T>& c){
+    const T h = c.step;
+    for(size_t i = lo; i<hi; ++i)
+        y[i] += dy[i]*h;
+}
+
+
+//hand written simd versions of the kernels above, for float strings.
+//each tier is compiled with its own target attribute, and picked at runtime from cpuid,
+//so the same binary runs on any x86-64 machine.
+//the avx tiers use fused multiply-add, so they agree with the scalar kernels to rounding, not bit for bit
+#ifdef MYSIMD_X86
+
+#define MYSIMD_SSE __attribute__((target("sse2")))
+#define MYSIMD_AVX2 __attribute__((target("avx2,fma")))
+#define MYSIMD_AVX512 __attribute__((target("avx512f")))
+
+MYSIMD_SSE inline void curvatureSSE(const float* __restrict y, float* __restrict curvature, size_t lo, size_t hi){
+    size_t i = lo;
+    for(; i+4<=hi; i+=4){
+        __m128 me = _mm_loadu_ps(y+i);
+        __m128 dylw = _mm_sub_ps(me, _mm_loadu_ps(y+i-1));
+        __m128 dyhg = _mm_sub_ps(_mm_loadu_ps(y+i+1), me);
+        _mm_storeu_ps(curvature+i, _mm_sub_ps(dylw, dyhg));
+    }
+    for(; i<hi; ++i) curvature[i] = (y[i]-y[i-1])-(y[i+1]-y[i]);
+}
+MYSIMD_SSE inline void strokeVelocitiesSSE(float* __restrict y, float* __restrict dy, const float* __restrict curvature, size_t lo, size_t hi, const StringCoefficients<float>& c){
+    const __m128 kh = _mm_set1_ps(c.stiffnessStep);
+    const __m128 ah = _mm_set1_ps(c.airStep);
+    const __m128 fh = _mm_set1_ps(c.frictionStep);
+    size_t i = lo;
+    for(; i+4<=hi; i+=4){
+        __m128 tail = _mm_add_ps(_mm_loadu_ps(curvature+i-1), _mm_mul_ps(fh, _mm_loadu_ps(curvature+i-2)));
+        __m128 ddy = _mm_add_ps(_mm_loadu_ps(curvature+i), _mm_mul_ps(fh, tail));
+        __m128 v = _mm_sub_ps(_mm_loadu_ps(dy+i), _mm_mul_ps(ddy, kh));
+        _mm_storeu_ps(dy+i, _mm_sub_ps(v, _mm_mul_ps(v, ah)));
+        _mm_storeu_ps(y+i, _mm_sub_ps(_mm_loadu_ps(y+i), _mm_mul_ps(ddy, fh)));
+    }
+    for(; i<hi; ++i){
+        float ddy = curvature[i] + c.frictionStep*(curvature[i-1] + c.frictionStep*curvature[i-2]);
+        float v = dy[i] - ddy*c.stiffnessStep;
+        dy[i] = v - v*c.airStep;
+        y[i] -= ddy*c.frictionStep;
+    }
+}
+MYSIMD_SSE inline void freeVelocitiesSSE(const float* __restrict y, float* __restrict dy, size_t lo, size_t hi, const StringCoefficients<float>& c){
+    const __m128 kh = _mm_set1_ps(c.stiffnessStep);
+    size_t i = lo;
+    for(; i+4<=hi; i+=4){
+        __m128 me = _mm_loadu_ps(y+i);
+        __m128 dylw = _mm_sub_ps(me, _mm_loadu_ps(y+i-1));
+        __m128 dyhg = _mm_sub_ps(_mm_loadu_ps(y+i+1), me);
+        _mm_storeu_ps(dy+i, _mm_sub_ps(_mm_loadu_ps(dy+i), _mm_mul_ps(_mm_sub_ps(dylw, dyhg), kh)));
+    }
+    for(; i<hi; ++i) dy[i] -= ((y[i]-y[i-1])-(y[i+1]-y[i]))*c.stiffnessStep;
+}
+MYSIMD_SSE inline void integrateSSE(float* __restrict y, const float* __restrict dy, size_t lo, size_t hi, const StringCoefficients<float>& c){
+    const __m128 h = _mm_set1_ps(c.step);
+    size_t i = lo;
+    for(; i+4<=hi; i+=4)
+        _mm_storeu_ps(y+i, _mm_add_ps(_mm_loadu_ps(y+i), _mm_mul_ps(_mm_loadu_ps(dy+i), h)));
+    for(; i<hi; ++i) y[i] += dy[i]*c.step;
+}
+
+MYSIMD_AVX2 inline void curvatureAVX2(const float* __restrict y, float* __restrict curvature, size_t lo, size_t hi){
+    size_t i = lo;
+    for(; i+8<=hi; i+=8){
+        __m256 me = _mm256_loadu_ps(y+i);
+        __m256 dylw = _mm256_sub_ps(me, _mm256_loadu_ps(y+i-1));
+        __m256 dyhg = _mm256_sub_ps(_mm256_loadu_ps(y+i+1), me);
+        _mm256_storeu_ps(curvature+i, _mm256_sub_ps(dylw, dyhg));
+    }
+    for(; i<hi; ++i) curvature[i] = (y[i]-y[i-1])-(y[i+1]-y[i]);
+}
+MYSIMD_AVX2 inline void strokeVelocitiesAVX2(float* __restrict y, float* __restrict dy, const float* __restrict curvature, size_t lo, size_t hi, const StringCoefficients<float>& c){
+    const __m256 kh = _mm256_set1_ps(c.stiffnessStep);
+    const __m256 ah = _mm256_set1_ps(c.airStep);
+    const __m256 fh = _mm256_set1_ps(c.frictionStep);
+    size_t i = lo;
+    for(; i+8<=hi; i+=8){
+        __m256 tail = _mm256_fmadd_ps(fh, _mm256_loadu_ps(curvature+i-2), _mm256_loadu_ps(curvature+i-1));
+        __m256 ddy = _mm256_fmadd_ps(fh, tail, _mm256_loadu_ps(curvature+i));
+        __m256 v = _mm256_fnmadd_ps(ddy, kh, _mm256_loadu_ps(dy+i));
+        _mm256_storeu_ps(dy+i, _mm256_fnmadd_ps(v, ah, v));
+        _mm256_storeu_ps(y+i, _mm256_fnmadd_ps(ddy, fh, _mm256_loadu_ps(y+i)));
+    }
+    for(; i<hi; ++i){
+        float ddy = curvature[i] + c.frictionStep*(curvature[i-1] + c.frictionStep*curvature[i-2]);
+        float v = dy[i] - ddy*c.stiffnessStep;
+        dy[i] = v - v*c.airStep;
+        y[i] -= ddy*c.frictionStep;
+    }
+}
+MYSIMD_AVX2 inline void freeVelocitiesAVX2(const float* __restrict y, float* __restrict dy, size_t lo, size_t hi, const StringCoefficients<float>& c){
+    const __m256 kh = _mm256_set1_ps(c.stiffnessStep);
+    size_t i = lo;
+    for(; i+8<=hi; i+=8){
+        __m256 me = _mm256_loadu_ps(y+i);
+        __m256 dylw = _mm256_sub_ps(me, _mm256_loadu_ps(y+i-1));
+        __m256 dyhg = _mm256_sub_ps(_mm256_loadu_ps(y+i+1), me);
+        _mm256_storeu_ps(dy+i, _mm256_fnmadd_ps(_mm256_sub_ps(dylw, dyhg), kh, _mm256_loadu_ps(dy+i)));
+    }
+    for(; i<hi; ++i) dy[i] -= ((y[i]-y[i-1])-(y[i+1]-y[i]))*c.stiffnessStep;
+}
+MYSIMD_AVX2 inline void integrateAVX2(float* __restrict y, const float* __restrict dy, size_t lo, size_t hi, const StringCoefficients<float>& c){
+    const __m256 h = _mm256_set1_ps(c.step);
+    size_t i = lo;
+    for(; i+8<=hi; i+=8)
+        _mm256_storeu_ps(y+i, _mm256_fmadd_ps(_mm256_loadu_ps(dy+i), h, _mm256_loadu_ps(y+i)));
+    for(; i<hi; ++i) y[i] += dy[i]*c.step;
+}
+
+//the avx-512 tier handles the ragged end of each range with masked loads and stores instead of a scalar tail
+MYSIMD_AVX512 inline __mmask16 tailMask512(size_t i, size_t hi){
+    return hi-i >= 16 ? __mmask16(0xFFFF) : __mmask16((1u<<(hi-i))-1u);
+}
+MYSIMD_AVX512 inline void curvatureAVX512(const float* __restrict y, float* __restrict curvature, size_t lo, size_t hi){
+    for(size_t i = lo; i<hi; i+=16){
+        __mmask16 m = tailMask512(i, hi);
+        __m512 me = _mm512_maskz_loadu_ps(m, y+i);
+        __m512 dylw = _mm512_sub_ps(me, _mm512_maskz_loadu_ps(m, y+i-1));
+        __m512 dyhg = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, y+i+1), me);
+        _mm512_mask_storeu_ps(curvature+i, m, _mm512_sub_ps(dylw, dyhg));
+    }
+}
+MYSIMD_AVX512 inline void strokeVelocitiesAVX512(float* __restrict y, float* __restrict dy, const float* __restrict curvature, size_t lo, size_t hi, const StringCoefficients<float>& c){
+    const __m512 kh = _mm512_set1_ps(c.stiffnessStep);
+    const __m512 ah = _mm512_set1_ps(c.airStep);
+    const __m512 fh = _mm512_set1_ps(c.frictionStep);
+    for(size_t i = lo; i<hi; i+=16){
+        __mmask16 m = tailMask512(i, hi);
+        __m512 tail = _mm512_fmadd_ps(fh, _mm512_maskz_loadu_ps(m, curvature+i-2), _mm512_maskz_loadu_ps(m, curvature+i-1));
+        __m512 ddy = _mm512_fmadd_ps(fh, tail, _mm512_maskz_loadu_ps(m, curvature+i));
+        __m512 v = _mm512_fnmadd_ps(ddy, kh, _mm512_maskz_loadu_ps(m, dy+i));
+        _mm512_mask_storeu_ps(dy+i, m, _mm512_fnmadd_ps(v, ah, v));
+        _mm512_mask_storeu_ps(y+i, m, _mm512_fnmadd_ps(ddy, fh, _mm512_maskz_loadu_ps(m, y+i)));
+    }
+}
+MYSIMD_AVX512 inline void freeVelocitiesAVX512(const float* __restrict y, float* __restrict dy, size_t lo, size_t hi, const StringCoefficients<float>& c){
+    const __m512 kh = _mm512_set1_ps(c.stiffnessStep);
+    for(size_t i = lo; i<hi; i+=16){
+        __mmask16 m = tailMask512(i, hi);
+        __m512 me = _mm512_maskz_loadu_ps(m, y+i);
+        __m512 dylw = _mm512_sub_ps(me, _mm512_maskz_loadu_ps(m, y+i-1));
+        __m512 dyhg = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, y+i+1), me);
+        _mm512_mask_storeu_ps(dy+i, m, _mm512_fnmadd_ps(_mm512_sub_ps(dylw, dyhg), kh, _mm512_maskz_loadu_ps(m, dy+i)));
+    }
+}
+MYSIMD_AVX512 inline void integrateAVX512(float* __restrict y, const float* __restrict dy, size_t lo, size_t hi, const StringCoefficients<float>& c){
+    const __m512 h = _mm512_set1_ps(c.step);
+    for(size_t i = lo; i<hi; i+=16){
+        __mmask16 m = tailMask512(i, hi);
+        _mm512_mask_storeu_ps(y+i, m, _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, dy+i), h, _mm512_maskz_loadu_ps(m, y+i)));
+    }
+}
+
+
+//hand written versions of the kernels for fixed point strings.
+//sums saturate, and products are rounded from the 64 bit product exactly like q30::multiplyRaw,
+//in the same order as the scalar kernels, so every tier steps to the same bits as the scalar kernels.
+//products only keep the low 32 bits of the rounded result, which is exact while one factor lies in [-1, 1].
+//every product here has a coefficient as one factor, and a string with coefficients outside [-1, 1] is unstable anyway
+MYSIMD_SSE inline __m128i load128(const q30* p){return _mm_loadu_si128((const __m128i*)(const void*)p);}
+MYSIMD_SSE inline void store128(q30* p, __m128i v){_mm_storeu_si128((__m128i*)(void*)p, v);}
+
+MYSIMD_SSE inline __m128i saturated128(__m128i a, __m128i r, __m128i overflow){
+    __m128i over = _mm_srai_epi32(overflow, 31);
+    __m128i sat = _mm_xor_si128(_mm_srai_epi32(a, 31), _mm_set1_epi32(INT32_MAX));
+    return _mm_or_si128(_mm_and_si128(over, sat), _mm_andnot_si128(over, r));
+}
+MYSIMD_SSE inline __m128i addSat128(__m128i a, __m128i b){
+    __m128i r = _mm_add_epi32(a, b);
+    return saturated128(a, r, _mm_andnot_si128(_mm_xor_si128(a, b), _mm_xor_si128(a, r)));
+}
+MYSIMD_SSE inline __m128i subSat128(__m128i a, __m128i b){
+    __m128i r = _mm_sub_epi32(a, b);
+    return saturated128(a, r, _mm_and_si128(_mm_xor_si128(a, b), _mm_xor_si128(a, r)));
+}
+//sse2 only multiplies unsigned, so the signed product takes the other factor off the high half for each negative one
+MYSIMD_SSE inline __m128i mulQ30_128(__m128i a, __m128i b){
+    const __m128i half = _mm_set1_epi64x(int64_t(1) << (q30::fractionBits-1));
+    const __m128i high = _mm_set1_epi64x(int64_t(0xFFFFFFFF00000000ull));
+    __m128i fix = _mm_add_epi32(_mm_and_si128(_mm_srai_epi32(a, 31), b), _mm_and_si128(_mm_srai_epi32(b, 31), a));
+    __m128i even = _mm_sub_epi64(_mm_mul_epu32(a, b), _mm_slli_epi64(fix, 32));
+    __m128i odd = _mm_sub_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32)), _mm_and_si128(fix, high));
+    even = _mm_srli_epi64(_mm_add_epi64(even, half), q30::fractionBits);
+    odd = _mm_slli_epi64(_mm_add_epi64(odd, half), 32-q30::fractionBits);
+    return _mm_or_si128(_mm_andnot_si128(high, even), _mm_and_si128(high, odd));
+}
+
+MYSIMD_SSE inline void curvatureFixedSSE(const q30* __restrict y, q30* __restrict curvature, size_t lo, size_t hi){
+    size_t i = lo;
+    for(; i+4<=hi; i+=4){
+        __m128i me = load128(y+i);
+        __m128i dylw = subSat128(me, load128(y+i-1));
+        __m128i dyhg = subSat128(load128(y+i+1), me);
+        store128(curvature+i, subSat128(dylw, dyhg));
+    }
+    curvatureSoA<q30>(y, curvature, i, hi);
+}
+MYSIMD_SSE inline void strokeVelocitiesFixedSSE(q30* __restrict y, q30* __restrict dy, const q30* __restrict curvature, size_t lo, size_t hi, const StringCoefficients<q30>& c){
+    const __m128i kh = _mm_set1_epi32(c.stiffnessStep.raw);
+    const __m128i ah = _mm_set1_epi32(c.airStep.raw);
+    const __m128i fh = _mm_set1_epi32(c.frictionStep.raw);
+    size_t i = lo;
+    for(; i+4<=hi; i+=4){
+        __m128i tail = addSat128(load128(curvature+i-1), mulQ30_128(fh, load128(curvature+i-2)));
+        __m128i ddy = addSat128(load128(curvature+i), mulQ30_128(fh, tail));
+        __m128i v = subSat128(load128(dy+i), mulQ30_128(ddy, kh));
+        store128(dy+i, subSat128(v, mulQ30_128(v, ah)));
+        store128(y+i, subSat128(load128(y+i), mulQ30_128(ddy, fh)));
+    }
+    strokeVelocitiesSoA<q30>(y, dy, curvature, i, hi, c);
+}
+MYSIMD_SSE inline void freeVelocitiesFixedSSE(const q30* __restrict y, q30* __restrict dy, size_t lo, size_t hi, const StringCoefficients<q30>& c){
+    const __m128i kh = _mm_set1_epi32(c.stiffnessStep.raw);
+    size_t i = lo;
+    for(; i+4<=hi; i+=4){
+        __m128i me = load128(y+i);
+        __m128i dylw = subSat128(me, load128(y+i-1));
+        __m128i dyhg = subSat128(load128(y+i+1), me);
+        store128(dy+i, subSat128(load128(dy+i), mulQ30_128(subSat128(dylw, dyhg), kh)));
+    }
+    freeVelocitiesSoA<q30>(y, dy, i, hi, c);
+}
+MYSIMD_SSE inline void integrateFixedSSE(q30* __restrict y, const q30* __restrict dy, size_t lo, size_t hi, const StringCoefficients<q30>& c){
+    const __m128i h = _mm_set1_epi32(c.step.raw);
+    size_t i = lo;
+    for(; i+4<=hi; i+=4)
+        store128(y+i, addSat128(load128(y+i), mulQ30_128(load128(dy+i), h)));
+    integrateSoA<q30>(y, dy, i, hi, c);
+}
+
+MYSIMD_AVX2 inline __m256i load256(const q30* p){return _mm256_loadu_si256((const __m256i*)(const void*)p);}
+MYSIMD_AVX2 inline void store256(q30* p, __m256i v){_mm256_storeu_si256((__m256i*)(void*)p, v);}
+
+MYSIMD_AVX2 inline __m256i saturated256(__m256i a, __m256i r, __m256i overflow){
+    __m256i sat = _mm256_xor_si256(_mm256_srai_epi32(a, 31), _mm256_set1_epi32(INT32_MAX));
+    return _mm256_blendv_epi8(r, sat, _mm256_srai_epi32(overflow, 31));
+}
+MYSIMD_AVX2 inline __m256i addSat256(__m256i a, __m256i b){
+    __m256i r = _mm256_add_epi32(a, b);
+    return saturated256(a, r, _mm256_andnot_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, r)));
+}
+MYSIMD_AVX2 inline __m256i subSat256(__m256i a, __m256i b){
+    __m256i r = _mm256_sub_epi32(a, b);
+    return saturated256(a, r, _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, r)));
+}
+MYSIMD_AVX2 inline __m256i mulQ30_256(__m256i a, __m256i b){
+    const __m256i half = _mm256_set1_epi64x(int64_t(1) << (q30::fractionBits-1));
+    __m256i even = _mm256_add_epi64(_mm256_mul_epi32(a, b), half);
+    __m256i odd = _mm256_add_epi64(_mm256_mul_epi32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32)), half);
+    return _mm256_blend_epi32(_mm256_srli_epi64(even, q30::fractionBits), _mm256_slli_epi64(odd, 32-q30::fractionBits), 0xAA);
+}
+
+MYSIMD_AVX2 inline void curvatureFixedAVX2(const q30* __restrict y, q30* __restrict curvature, size_t lo, size_t hi){
+    size_t i = lo;
+    for(; i+8<=hi; i+=8){
+        __m256i me = load256(y+i);
+        __m256i dylw = subSat256(me, load256(y+i-1));
+        __m256i dyhg = subSat256(load256(y+i+1), me);
+        store256(curvature+i, subSat256(dylw, dyhg));
+    }
+    curvatureSoA<q30>(y, curvature, i, hi);
+}
+MYSIMD_AVX2 inline void strokeVelocitiesFixedAVX2(q30* __restrict y, q30* __restrict dy, const q30* __restrict curvature, size_t lo, size_t hi, const StringCoefficients<q30>& c){
+    const __m256i kh = _mm256_set1_epi32(c.stiffnessStep.raw);
+    const __m256i ah = _mm256_set1_epi32(c.airStep.raw);
+    const __m256i fh = _mm256_set1_epi32(c.frictionStep.raw);
+    size_t i = lo;
+    for(; i+8<=hi; i+=8){
+        __m256i tail = addSat256(load256(curvature+i-1), mulQ30_256(fh, load256(curvature+i-2)));
+        __m256i ddy = addSat256(load256(curvature+i), mulQ30_256(fh, tail));
+        __m256i v = subSat256(load256(dy+i), mulQ30_256(ddy, kh));
+        store256(dy+i, subSat256(v, mulQ30_256(v, ah)));
+        store256(y+i, subSat256(load256(y+i), mulQ30_256(ddy, fh)));
+    }
+    strokeVelocitiesSoA<q30>(y, dy, curvature, i, hi, c);
+}
+MYSIMD_AVX2 inline void freeVelocitiesFixedAVX2(const q30* __restrict y, q30* __restrict dy, size_t lo, size_t hi, const StringCoefficients<q30>& c){
+    const __m256i kh = _mm256_set1_epi32(c.stiffnessStep.raw);
+    size_t i = lo;
+    for(; i+8<=hi; i+=8){
+        __m256i me = load256(y+i);
+        __m256i dylw = subSat256(me, load256(y+i-1));
+        __m256i dyhg = subSat256(load256(y+i+1), me);
+        store256(dy+i, subSat256(load256(dy+i), mulQ30_256(subSat256(dylw, dyhg), kh)));
+    }
+    freeVelocitiesSoA<q30>(y, dy, i, hi, c);
+}
+MYSIMD_AVX2 inline void integrateFixedAVX2(q30* __restrict y, const q30* __restrict dy, size_t lo, size_t hi, const StringCoefficients<q30>& c){
+    const __m256i h = _mm256_set1_epi32(c.step.raw);
+    size_t i = lo;
+    for(; i+8<=hi; i+=8)
+        store256(y+i, addSat256(load256(y+i), mulQ30_256(load256(dy+i), h)));
+    integrateSoA<q30>(y, dy, i, hi, c);
+}
+
+//gcc 12 warns about the deliberately undefined registers inside its own avx-512 integer intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+MYSIMD_AVX512 inline __m512i load512(__mmask16 m, const q30* p){return _mm512_maskz_loadu_epi32(m, (const void*)p);}
+MYSIMD_AVX512 inline void store512(q30* p, __mmask16 m, __m512i v){_mm512_mask_storeu_epi32((void*)p, m, v);}
+
+MYSIMD_AVX512 inline __m512i saturated512(__m512i a, __m512i r, __m512i overflow){
+    __m512i sat = _mm512_xor_si512(_mm512_srai_epi32(a, 31), _mm512_set1_epi32(INT32_MAX));
+    return _mm512_mask_blend_epi32(_mm512_cmplt_epi32_mask(overflow, _mm512_setzero_si512()), r, sat);
+}
+MYSIMD_AVX512 inline __m512i addSat512(__m512i a, __m512i b){
+    __m512i r = _mm512_add_epi32(a, b);
+    return saturated512(a, r, _mm512_andnot_si512(_mm512_xor_si512(a, b), _mm512_xor_si512(a, r)));
+}
+MYSIMD_AVX512 inline __m512i subSat512(__m512i a, __m512i b){
+    __m512i r = _mm512_sub_epi32(a, b);
+    return saturated512(a, r, _mm512_and_si512(_mm512_xor_si512(a, b), _mm512_xor_si512(a, r)));
+}
+MYSIMD_AVX512 inline __m512i mulQ30_512(__m512i a, __m512i b){
+    const __m512i half = _mm512_set1_epi64(int64_t(1) << (q30::fractionBits-1));
+    __m512i even = _mm512_add_epi64(_mm512_mul_epi32(a, b), half);
+    __m512i odd = _mm512_add_epi64(_mm512_mul_epi32(_mm512_srli_epi64(a, 32), _mm512_srli_epi64(b, 32)), half);
+    return _mm512_mask_blend_epi32(__mmask16(0xAAAA), _mm512_srli_epi64(even, q30::fractionBits), _mm512_slli_epi64(odd, 32-q30::fractionBits));
+}
+
+MYSIMD_AVX512 inline void curvatureFixedAVX512(const q30* __restrict y, q30* __restrict curvature, size_t lo, size_t hi){
+    for(size_t i = lo; i<hi; i+=16){
+        __mmask16 m = tailMask512(i, hi);
+        __m512i me = load512(m, y+i);
+        __m512i dylw = subSat512(me, load512(m, y+i-1));
+        __m512i dyhg = subSat512(load512(m, y+i+1), me);
+        store512(curvature+i, m, subSat512(dylw, dyhg));
+    }
+}
+MYSIMD_AVX512 inline void strokeVelocitiesFixedAVX512(q30* __restrict y, q30* __restrict dy, const q30* __restrict curvature, size_t lo, size_t hi, const StringCoefficients<q30>& c){
+    const __m512i kh = _mm512_set1_epi32(c.stiffnessStep.raw);
+    const __m512i ah = _mm512_set1_epi32(c.airStep.raw);
+    const __m512i fh = _mm512_set1_epi32(c.frictionStep.raw);
+    for(size_t i = lo; i<hi; i+=16){
+        __mmask16 m = tailMask512(i, hi);
+        __m512i tail = addSat512(load512(m, curvature+i-1), mulQ30_512(fh, load512(m, curvature+i-2)));
+        __m512i ddy = addSat512(load512(m, curvature+i), mulQ30_512(fh, tail));
+        __m512i v = subSat512(load512(m, dy+i), mulQ30_512(ddy, kh));
+        store512(dy+i, m, subSat512(v, mulQ30_512(v, ah)));
+        store512(y+i, m, subSat512(load512(m, y+i), mulQ30_512(ddy, fh)));
+    }
+}
+MYSIMD_AVX512 inline void freeVelocitiesFixedAVX512(const q30* __restrict y, q30* __restrict dy, size_t lo, size_t hi, const StringCoefficients<q30>& c){
+    const __m512i kh = _mm512_set1_epi32(c.stiffnessStep.raw);
+    for(size_t i = lo; i<hi; i+=16){
+        __mmask16 m = tailMask512(i, hi);
+        __m512i me = load512(m, y+i);
+        __m512i dylw = subSat512(me, load512(m, y+i-1));
+        __m512i dyhg = subSat512(load512(m, y+i+1), me);
+        store512(dy+i, m, subSat512(load512(m, dy+i), mulQ30_512(subSat512(dylw, dyhg), kh)));
+    }
+}
+MYSIMD_AVX512 inline void integrateFixedAVX512(q30* __restrict y, const q30* __restrict dy, size_t lo, size_t hi, const StringCoefficients<q30>& c){
+    const __m512i h = _mm512_set1_epi32(c.step.raw);
+    for(size_t i = lo; i<hi; i+=16){
+        __mmask16 m = tailMask512(i, hi);
+        store512(y+i, m, addSat512(load512(m, y+i), mulQ30_512(load512(m, dy+i), h)));
+    }
+}
+#pragma GCC diagnostic pop
+
+#endif
+
+//the set of kernels a SegmentArrays string steps with
+template<typename T>
+struct StringKernelTable{
+    void (*curvature)(const T*, T*, size_t, size_t);
+    void (*strokeVelocities)(T*, T*, const T*, size_t, size_t, const StringCoefficients<T>&);
+    void (*freeVelocities)(const T*, T*, size_t, size_t, const StringCoefficients<T>&);
+    void (*integrate)(T*, const T*, size_t, size_t, const StringCoefficients<T>&);
+};
+
+//kernels for a given tier. types without hand written versions get the scalar kernels,
+//which the compiler is still free to vectorize for the baseline instruction set
+template<typename T>
+StringKernelTable<T> stringKernelTable(SimdLevel level){
+    (void)level;
+    return {curvatureSoA<T>, strokeVelocitiesSoA<T>, freeVelocitiesSoA<T>, integrateSoA<T>};
+}
+template<>
+inline StringKernelTable<float> stringKernelTable<float>(SimdLevel level){
+#ifdef MYSIMD_X86
+    switch(level){
+        case SimdLevel::sse: return {curvatureSSE, strokeVelocitiesSSE, freeVelocitiesSSE, integrateSSE};
+        case SimdLevel::avx2: return {curvatureAVX2, strokeVelocitiesAVX2, freeVelocitiesAVX2, integrateAVX2};
+        case SimdLevel::avx512: return {curvatureAVX512, strokeVelocitiesAVX512, freeVelocitiesAVX512, integrateAVX512};
+        default: break;
+    }
+#else
+    (void)level;
+#endif
+    return {curvatureSoA<float>, strokeVelocitiesSoA<float>, freeVelocitiesSoA<float>, integrateSoA<float>};
+}
+template<>
+inline StringKernelTable<q30> stringKernelTable<q30>(SimdLevel level){
+#ifdef MYSIMD_X86
+    switch(level){
+        case SimdLevel::sse: return {curvatureFixedSSE, strokeVelocitiesFixedSSE, freeVelocitiesFixedSSE, integrateFixedSSE};
+        case SimdLevel::avx2: return {curvatureFixedAVX2, strokeVelocitiesFixedAVX2, freeVelocitiesFixedAVX2, integrateFixedAVX2};
+        case SimdLevel::avx512: return {curvatureFixedAVX512, strokeVelocitiesFixedAVX512, freeVelocitiesFixedAVX512, integrateFixedAVX512};
+        default: break;
+    }
+#else
+    (void)level;
+#endif
+    return {curvatureSoA<q30>, strokeVelocitiesSoA<q30>, freeVelocitiesSoA<q30>, integrateSoA<q30>};
+}
+
+//kernels for the best tier this machine supports, chosen once at startup
+template<typename T>
+const StringKernelTable<T>& stringKernels(){
+    static const StringKernelTable<T> table = stringKernelTable<T>(simdLevel());
+    return table;
+}
+
+//solver for the tridiagonal system (I + c*L)x = r of the implicit String step,
+//where L is the curvature operator 2x[i]-x[i-1]-x[i+1] with fixed ends, over n moving segments.
+//the matrix only changes with c and n, so the Thomas factorization is computed once and cached.
+//its pivots settle to a constant after the first few rows, from where both sweeps become
+//the recurrence g[i] = s[i] + w*g[i-1] with a fixed w. that is solved Lanes rows at a time,
+//as a triangular matrix of powers of w times the row plus the carry from the row before,
+//which runs as vector extension rows instead of one serial chain through every segment
+template<typename T>
+struct ThomasSolver{
+    static constexpr size_t Lanes = 8;
+    typedef ::Row<T, Lanes> Row;
+
+    //recomputes the factorization if c or n changed
+    void factor(T coupling, size_t rows){
+        if(coupling == c && rows == n) return;
+        c = coupling;
+        n = rows;
+        double b = 1+2*double(c);
+        double settledPivot = 2/(b + sqrt(b*b - 4*double(c)*double(c)));
+        pivots.clear();
+        double p = 1/b;
+        while(pivots.size() < n && fabs(p-settledPivot) > double(std::numeric_limits<T>::epsilon())*settledPivot){
+            pivots.push_back(T(p));
+            p = 1/(b - double(c)*double(c)*p);
+        }
+        settled = pivots.size();
+        pivot = T(settledPivot);
+        w = c*pivot;
+
+        //powers[k] = w^k
+        std::array<T, Lanes+1> powers;
+        powers[0] = 1;
+        for(size_t k = 1; k<=Lanes; ++k) powers[k] = powers[k-1]*w;
+        for(size_t m = 0; m<Lanes; ++m){
+            for(size_t l = 0; l<Lanes; ++l){
+                forward[m][l] = l >= m ? powers[l-m] : T(0);
+                backward[m][l] = l <= m ? powers[m-l] : T(0);
+            }
+        }
+        for(size_t l = 0; l<Lanes; ++l){
+            forwardCarry[l] = powers[l+1];
+            backwardCarry[l] = powers[Lanes-l];
+        }
+    }
+
+    //solves in place, x holds r on entry
+    void solve(T* x) const {
+        size_t blocks = n > settled ? (n-settled)/Lanes : 0;
+        size_t top = settled + blocks*Lanes;
+        Row s, g;
+
+        //forward sweep, g[i] = (r[i] + c*g[i-1])*pivot[i]
+        T prev = 0;
+        for(size_t i = 0; i<settled; ++i) prev = x[i] = (x[i] + c*prev)*pivots[i];
+        for(size_t i = settled; i<top; i+=Lanes){
+            loadRow(s, x+i);
+            s *= pivot;
+            g = forward[0]*s[0];
+#pragma GCC unroll 8
+            for(size_t m = 1; m<Lanes; ++m) g += forward[m]*s[m];
+            //the carry goes last, so only it waits for the block before
+            g += forwardCarry*prev;
+            storeRow(x+i, g);
+            prev = g[Lanes-1];
+        }
+        for(size_t i = top; i<n; ++i) prev = x[i] = (x[i] + c*prev)*pivot;
+
+        //back substitution, x[i] = g[i] + c*pivot[i]*x[i+1]
+        T next = 0;
+        for(size_t i = n; i-- > top;) next = x[i] += w*next;
+        for(size_t i = top; i>settled;){
+            i -= Lanes;
+            loadRow(s, x+i);
+            g = backward[0]*s[0];
+#pragma GCC unroll 8
+            for(size_t m = 1; m<Lanes; ++m) g += backward[m]*s[m];
+            g += backwardCarry*next;
+            storeRow(x+i, g);
+            next = g[0];
+        }
+        for(size_t i = settled; i-- > 0;) next = x[i] += c*pivots[i]*next;
+    }
+
+private:
+    T c = -1;
+    size_t n = 0;
+    //pivots of the rows before they settle, and the settled pivot
+    std::vector<T> pivots;
+    size_t settled = 0;
+    T pivot = 0;
+    T w = 0;
+    //column m of the triangular block matrices, and the weights of the carried row
+    Row forward[Lanes], backward[Lanes];
+    Row forwardCarry, backwardCarry;
+
+};
+
+//runs every supported tier against the scalar kernels on the same random string,
+//and reports the largest offset deviation relative to the largest offset.
+//the sse tier matches the scalar kernels exactly. the avx tiers drift by about 1e-5
+//over 256 steps of a 1000 segment string, from fused multiply-add rounding alone,
+//so the default tolerance is 1e-4
+template<typename T>
+bool stringKernelsAgree(T tolerance = T(1e-4), size_t segments = 1000, uint steps = 256){
+    StringCoefficients<T> c = {T(1)/T(44100), T(1600000000), T(0.2), T(0.02), T(0), T(0), T(0)};
+    c.stiffnessStep = c.stiffness*c.step;
+    c.airStep = c.air*c.step;
+    c.frictionStep = c.friction*c.step;
+
+    std::vector<T> y0(segments, T(0));
+    for(size_t i = 1; i<segments-1; ++i) y0[i] = T(randomUnitFloat()*0.1f);
+
+    auto run = [&](const StringKernelTable<T>& k, std::vector<T>& y){
+        std::vector<T> dy(segments, T(0)), curvature(segments+2, T(0));
+        y = y0;
+        for(uint s = 0; s<steps; ++s){
+            k.curvature(y.data(), curvature.data()+2, 1, segments-1);
+            k.strokeVelocities(y.data(), dy.data(), curvature.data()+2, 1, segments-1, c);
+            k.integrate(y.data(), dy.data(), 1, segments-1, c);
+            k.freeVelocities(y.data(), dy.data(), 1, segments-1, c);
+            k.integrate(y.data(), dy.data(), 1, segments-1, c);
+        }
+    };
+    std::vector<T> reference, tested;
+    run(stringKernelTable<T>(SimdLevel::scalar), reference);
+    T scale = 0;
+    for(T v : reference) scale = std::max(scale, T(fabs(v)));
+
+    bool agree = true;
+    for(SimdLevel level : {SimdLevel::sse, SimdLevel::avx2, SimdLevel::avx512}){
+        if(!simdLevelSupported(level)) continue;
+        run(stringKernelTable<T>(level), tested);
+        T deviation = 0;
+        for(size_t i = 0; i<segments; ++i) deviation = std::max(deviation, T(fabs(tested[i]-reference[i])));
+        deviation /= scale;
+        if(deviation > tolerance){
+            std::cerr << "string kernels for " << simdLevelName(level) << " deviate by " << deviation << '\n';
+            agree = false;
+        }
+    }
+    return agree;
+}
+
+//the same check for fixed point strings, where every tier has to match the scalar kernels bit for bit.
+//the coefficients are those of a default String<q30>, with velocities in offset per step
+inline bool fixedKernelsAgree(size_t segments = 1000, uint steps = 256){
+    const double h = 1./44100.;
+    StringCoefficients<q30> c = {q30(1.), q30(0.), q30(0.), q30(0.), q30(1600000000.*h*h), q30(0.2*h), q30(0.02*h)};
+
+    std::vector<q30> y0(segments);
+    for(size_t i = 1; i<segments-1; ++i) y0[i] = randomUnitFloat()*0.1f;
+
+    auto run = [&](const StringKernelTable<q30>& k, std::vector<q30>& y){
+        std::vector<q30> dy(segments), curvature(segments+2);
+        y = y0;
+        for(uint s = 0; s<steps; ++s){
+            k.curvature(y.data(), curvature.data()+2, 1, segments-1);
+            k.strokeVelocities(y.data(), dy.data(), curvature.data()+2, 1, segments-1, c);
+            k.integrate(y.data(), dy.data(), 1, segments-1, c);
+            k.freeVelocities(y.data(), dy.data(), 1, segments-1, c);
+            k.integrate(y.data(), dy.data(), 1, segments-1, c);
+        }
+    };
+    std::vector<q30> reference, tested;
+    run(stringKernelTable<q30>(SimdLevel::scalar), reference);
+
+    bool agree = true;
+    for(SimdLevel level : {SimdLevel::sse, SimdLevel::avx2, SimdLevel::avx512}){
+        if(!simdLevelSupported(level)) continue;
+        run(stringKernelTable<q30>(level), tested);
+        if(tested != reference){
+            std::cerr << "fixed point string kernels for " << simdLevelName(level) << " differ from the scalar kernels\n";
+            agree = false;
+        }
+    }
+    return agree;
+}
@@ -37,6 +37,18 @@ static const int SLICES_PER_CIRCLE = 45;
 [[maybe_unused]] static std::array<SDL_Point, SLICES_PER_CIRCLE + 1> circleBorderBuffer;
 }  // namespace internal
 
+//modded begin
+// A mouse motion or button event, with the time SDL received it
+struct MouseEvent {
+    // SDL_GetTicks() time of the event, in milliseconds
+    uint32_t timestamp;
+    TDT4102::Point position;
+    // Button states after the event
+    bool leftButton;
+    bool rightButton;
+};
+//modded end
+
 class AnimationWindow {
    private:
     void show_frame();
@@ -70,6 +82,9 @@ class AnimationWindow {
     bool currentLeftMouseButtonState = false;
     bool currentRightMouseButtonState = false;
     float deltaMouseWheel = 0;
+    std::vector<MouseEvent> mouseEvents; //modded
+    uint32_t eventTime = 0; //modded
+    uint32_t previousEventTime = 0; //modded
 
    public:
     explicit AnimationWindow(int x = 50, int y = 50, int width = 1024, int height = 768, const std::string& title = "Animation Window");
@@ -113,6 +128,20 @@ class AnimationWindow {
     float getScrollWheelMotion() const{
         return deltaMouseWheel;
     }
+    //modded begin
+    // The mouse events of the last frame in the order they happened, so input can be replayed with its timing.
+    // They happened between get_previous_event_time() and get_event_time()
+    const std::vector<MouseEvent>& get_mouse_events() const{
+        return mouseEvents;
+    }
+    // SDL_GetTicks() time at which the events of the last frame were collected, and that of the frame before
+    uint32_t get_event_time() const{
+        return eventTime;
+    }
+    uint32_t get_previous_event_time() const{
+        return previousEventTime;
+    }
+    //modded end
 
     // Add a GUI widget to the window such that it becomes visible and the user can interact with it
     void add(TDT4102::Widget& widgetToAdd);
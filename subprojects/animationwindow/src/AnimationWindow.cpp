@@ -79,6 +79,8 @@ void TDT4102::AnimationWindow::show_frame() {
     SDL_RenderPresent(rendererHandle);
 
     deltaMouseWheel = 0; //modded
+    mouseEvents.clear(); //modded
+    previousEventTime = eventTime; //modded
 
     SDL_Event event;
     nk_input_begin(context);
@@ -98,18 +100,24 @@ void TDT4102::AnimationWindow::show_frame() {
             } else if (event.button.button == SDL_BUTTON_RIGHT) {
                 currentRightMouseButtonState = true;
             }
+            mouseEvents.push_back({event.button.timestamp, {event.button.x, event.button.y}, currentLeftMouseButtonState, currentRightMouseButtonState}); //modded
         } else if (event.type == SDL_MOUSEBUTTONUP) {
             if (event.button.button == SDL_BUTTON_LEFT) {
                 currentLeftMouseButtonState = false;
             } else if (event.button.button == SDL_BUTTON_RIGHT) {
                 currentRightMouseButtonState = false;
             }
+            mouseEvents.push_back({event.button.timestamp, {event.button.x, event.button.y}, currentLeftMouseButtonState, currentRightMouseButtonState}); //modded
+        }
+        else if(event.type == SDL_MOUSEMOTION){ //modded
+            mouseEvents.push_back({event.motion.timestamp, {event.motion.x, event.motion.y}, currentLeftMouseButtonState, currentRightMouseButtonState});
         }
         else if(event.type == SDL_MOUSEWHEEL){ //modded
             deltaMouseWheel = event.wheel.preciseY;
         }
         nk_sdl_handle_event(&event);
     }
+    eventTime = SDL_GetTicks(); //modded
     nk_input_end(context);
 }
 